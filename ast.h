@@ -1,25 +1,52 @@
 #include <iostream>
 #include <vector>
 #include <llvm-7/llvm/IR/Value.h>
+#include "types.h"
 
 class GeneratorContext;
+class TypeChecker;
 class Statement;
 class Expression;
 class VariableDeclaration;
+class Reduction;
+class FunctionSignature;
+class CaseRange;
+class MatchCase;
 
 typedef std::vector<Statement *> StatementList;
 typedef std::vector<Expression *> ExpressionList;
 typedef std::vector<VariableDeclaration *> VariableList;
+typedef std::vector<Reduction *> ReductionList;
+typedef std::vector<CaseRange *> CaseRangeList;
+typedef std::vector<MatchCase *> MatchCaseList;
+
+/**
+ * Lines and columns of the first and last character of node in source file.
+ */
+class SourceSpan
+{
+public:
+    int firstLine = 0;
+    int firstColumn = 0;
+    int lastLine = 0;
+    int lastColumn = 0;
+};
 
 class Node
 {
 public:
+    // Set by parser, zero for nodes created by later passes without source
+    SourceSpan span;
     virtual ~Node() {}
     virtual llvm::Value *generateCode(GeneratorContext &context){};
+    virtual void checkTypes(TypeChecker &checker) {}
 };
 
 class Expression : public Node
 {
+public:
+    // Annotated by type checker before code generation
+    ValueType valueType;
 };
 
 class Statement : public Node
@@ -30,7 +57,7 @@ class Integer : public Expression
 {
 public:
     long long value;
-    Integer(long long value) : value(value) {}
+    Integer(long long value) : value(value) { valueType = ValueType::fromName("Int"); }
     virtual llvm::Value *generateCode(GeneratorContext &context);
 };
 
@@ -38,7 +65,7 @@ class Double : public Expression
 {
 public:
     double value;
-    Double(double value) : value(value) {}
+    Double(double value) : value(value) { valueType = ValueType::fromName("Double"); }
     virtual llvm::Value *generateCode(GeneratorContext &context);
 };
 
@@ -46,7 +73,7 @@ class String : public Expression
 {
 public:
     std::string value;
-    String(std::string value) : value(value) { }
+    String(std::string value) : value(value) { valueType = ValueType::fromName("String"); }
     virtual llvm::Value *generateCode(GeneratorContext &context);
 };
 
@@ -56,6 +83,7 @@ public:
     std::string name;
     Identifier(const std::string name) : name(name) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class MethodCall : public Expression
@@ -63,28 +91,36 @@ class MethodCall : public Expression
 public:
     const Identifier &id;
     ExpressionList arguments;
+    // Call of alloc or free provided by runtime, set by type checker
+    bool isBuiltin = false;
     MethodCall(const Identifier &id) : id(id) {}
     MethodCall(const Identifier &id, ExpressionList &arguments) : id(id), arguments(arguments) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+    // Convert arguments to parameter types, returns NULL for undefined function
+    FunctionSignature *checkArguments(TypeChecker &checker);
+    void checkBuiltin(TypeChecker &checker);
 };
 
 class BinaryOperator : public Expression
 {
 public:
     int op;
-    Expression &lhs;
-    Expression &rhs;
-    BinaryOperator(Expression &lhs, int op, Expression &rhs) : lhs(lhs), op(op), rhs(rhs) {}
+    Expression *lhs;
+    Expression *rhs;
+    BinaryOperator(Expression *lhs, int op, Expression *rhs) : lhs(lhs), op(op), rhs(rhs) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class UnaryOperator : public Expression
 {
 public:
     int op;
-    Expression &exp;
-    UnaryOperator(Expression &exp, int op) : exp(exp), op(op) {}
+    Expression *exp;
+    UnaryOperator(Expression *exp, int op) : exp(exp), op(op) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class InversionOperator : public Expression
@@ -94,15 +130,39 @@ public:
     Expression &rhs;
     InversionOperator(int op, Expression &rhs) : op(op), rhs(rhs) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class Assignment : public Expression
 {
 public:
     Identifier &lhs;
-    Expression &rhs;
-    Assignment(Identifier &lhs, Expression &rhs) : lhs(lhs), rhs(rhs) {}
+    Expression *rhs;
+    Assignment(Identifier &lhs, Expression *rhs) : lhs(lhs), rhs(rhs) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Element of buffer, index counts elements
+class ElementAccess : public Expression
+{
+public:
+    Identifier &id;
+    Expression *index;
+    ElementAccess(Identifier &id, Expression *index) : id(id), index(index) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+class ElementAssignment : public Expression
+{
+public:
+    Identifier &id;
+    Expression *index;
+    Expression *rhs;
+    ElementAssignment(Identifier &id, Expression *index, Expression *rhs) : id(id), index(index), rhs(rhs) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class Block : public Expression
@@ -111,6 +171,20 @@ public:
     StatementList statements;
     Block() {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Explicit conversion inserted by type checker, valueType is the target type
+class Conversion : public Expression
+{
+public:
+    Expression *exp;
+    Conversion(Expression *exp, const ValueType &type) : exp(exp)
+    {
+        valueType = type;
+        span = exp->span;
+    }
+    virtual llvm::Value *generateCode(GeneratorContext &context);
 };
 
 class ExpressionStatement : public Statement
@@ -119,6 +193,7 @@ public:
     Expression &expression;
     ExpressionStatement(Expression &expression) : expression(expression) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class VariableDeclaration : public Statement
@@ -127,9 +202,10 @@ public:
     Identifier &type;
     Identifier &id;
     Expression *assignmentExpression;
-    VariableDeclaration(Identifier &type, Identifier &id) : type(type), id(id) {}
+    VariableDeclaration(Identifier &type, Identifier &id) : type(type), id(id), assignmentExpression(NULL) {}
     VariableDeclaration(Identifier &type, Identifier &id, Expression *assignmentExpression) : type(type), id(id), assignmentExpression(assignmentExpression) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class FunctionDeclaration : public Statement
@@ -139,8 +215,14 @@ public:
     const Identifier &id;
     VariableList arguments;
     Block &block;
+    // Body contains yield, function returns coroutine handle instead of value, set by type checker
+    bool isGenerator = false;
     FunctionDeclaration(const Identifier &type, const Identifier &id, const VariableList &arguments, Block &block) : type(type), id(id), arguments(arguments), block(block) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+    // Declare function without body, so calls may precede the definition
+    llvm::Function *generatePrototype(GeneratorContext &context);
+    void checkSignature(TypeChecker &checker);
 };
 
 class Conditional : public Statement
@@ -156,14 +238,27 @@ public:
     }
     Conditional(Expression *comparison, Block *thenBlockNode, Block *elseBlockNode) : comparison(comparison), thenBlockNode(thenBlockNode), elseBlockNode(elseBlockNode) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class ReturnStatement : public Statement
 {
 public:
-    Expression &returnExpression;
-    ReturnStatement(Expression &returnExpression) : returnExpression(returnExpression) {}
+    Expression *returnExpression;
+    // Last statement of function body or of a branch outside loops, set before code generation
+    bool isTail;
+    ReturnStatement(Expression *returnExpression) : returnExpression(returnExpression), isTail(false) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+class YieldStatement : public Statement
+{
+public:
+    Expression *yieldExpression;
+    YieldStatement(Expression *yieldExpression) : yieldExpression(yieldExpression) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
 
 class While : public Statement
@@ -174,7 +269,91 @@ public:
     Statement *postLoop;
     Statement *loopVariable;
 
-    While(Expression *comparison, Block *bodyBlock) : comparison(comparison), body(bodyBlock) {}
+    While(Expression *comparison, Block *bodyBlock) : comparison(comparison), body(bodyBlock), postLoop(nullptr), loopVariable(nullptr) {}
     While(Expression *comparison, Block *bodyBlock, Statement *postLoop, Statement *loopVar) : comparison(comparison), body(bodyBlock), postLoop(postLoop), loopVariable(loopVar) {}
     virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Runs body for every value yielded by generator call
+class GeneratorLoop : public Statement
+{
+public:
+    Identifier &id;
+    Expression *sequence;
+    Block *body;
+    // Type of yielded values, set by type checker
+    ValueType elementType;
+
+    GeneratorLoop(Identifier &id, Expression *sequence, Block *bodyBlock) : id(id), sequence(sequence), body(bodyBlock) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Inclusive range of values matched by case, single value has low equal to high, `_` is an identifier
+class CaseRange
+{
+public:
+    Expression *low;
+    Expression *high;
+    // Constant bounds, set by type checker
+    long long lowValue = 0;
+    long long highValue = 0;
+    CaseRange(Expression *low, Expression *high) : low(low), high(high) {}
+};
+
+class MatchCase : public Node
+{
+public:
+    CaseRangeList ranges;
+    Block *body;
+    // Case is `_`, taken when no other case matches, set by type checker
+    bool isDefault = false;
+    MatchCase(const CaseRangeList &ranges, Block *body) : ranges(ranges), body(body) {}
+};
+
+// Runs the case whose ranges contain value of subject, cases must not overlap and must cover every value
+class Match : public Statement
+{
+public:
+    Expression *subject;
+    MatchCaseList cases;
+    Match(Expression *subject, const MatchCaseList &cases) : subject(subject), cases(cases) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Allocations made while body runs come from an arena released when it is left
+class Region : public Statement
+{
+public:
+    Block *body;
+    Region(Block *body) : body(body) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
+};
+
+// Accumulator combined across parallel loop chunks, op is one of +, *, min, max
+class Reduction
+{
+public:
+    Identifier &id;
+    std::string op;
+    Reduction(Identifier &id, const std::string op) : id(id), op(op) {}
+};
+
+class ParallelLoop : public Statement
+{
+public:
+    Statement *loopVariable;
+    Expression *comparison;
+    Statement *postLoop;
+    Block *body;
+    ReductionList reductions;
+    // Increment of loop variable per iteration, set by type checker
+    long long step = 0;
+
+    ParallelLoop(Statement *loopVar, Expression *comparison, Statement *postLoop, Block *bodyBlock, const ReductionList &reductions) : loopVariable(loopVar), comparison(comparison), postLoop(postLoop), body(bodyBlock), reductions(reductions) {}
+    virtual llvm::Value *generateCode(GeneratorContext &context);
+    virtual void checkTypes(TypeChecker &checker);
 };
\ No newline at end of file
@@ -0,0 +1,756 @@
+#include "ast.h"
+#include "checker.hpp"
+#include "parser.hpp"
+#include <algorithm>
+#include <climits>
+
+bool TypeChecker::check(Block &root)
+{
+    errorCount = 0;
+    returnType = ValueType(ValueType::Void);
+
+    // Top level functions can be called before they are defined
+    for (Statement *statement : root.statements)
+        if (FunctionDeclaration *function = dynamic_cast<FunctionDeclaration *>(statement))
+            function->checkSignature(*this);
+
+    pushScope(false);
+    root.checkTypes(*this);
+    popScope();
+
+    return errorCount == 0;
+}
+
+void TypeChecker::error(const std::string &message)
+{
+    std::cerr << message << std::endl;
+    errorCount++;
+}
+
+// Return source level type from type name, reporting unknown names
+ValueType TypeChecker::typeOf(const std::string &name)
+{
+    bool valid;
+    ValueType type = ValueType::fromName(name, &valid);
+
+    if (!valid)
+        error("Type " + name + " is unknown.");
+
+    return type;
+}
+
+// Literals take the type of the other operand instead of forcing it wider
+static bool isLiteral(Expression &expression)
+{
+    return dynamic_cast<Integer *>(&expression) != NULL || dynamic_cast<Double *>(&expression) != NULL;
+}
+
+/*
+    Type both operands of binary operator are converted to.
+    Floating point wins over integers, wider wins over narrower and on
+    equal width unsigned wins over signed. Bool takes part as UInt8.
+*/
+ValueType TypeChecker::commonType(Expression &lhs, Expression &rhs)
+{
+    ValueType lhsType = lhs.valueType.kind == ValueType::Bool ? ValueType(ValueType::Integer, 8, false) : lhs.valueType;
+    ValueType rhsType = rhs.valueType.kind == ValueType::Bool ? ValueType(ValueType::Integer, 8, false) : rhs.valueType;
+
+    if (!lhsType.isNumeric() || !rhsType.isNumeric())
+        return ValueType(ValueType::Void);
+
+    if (isLiteral(lhs) && !isLiteral(rhs) && (lhsType.isInteger() || rhsType.isFloat()))
+        return rhsType;
+    if (isLiteral(rhs) && !isLiteral(lhs) && (rhsType.isInteger() || lhsType.isFloat()))
+        return lhsType;
+
+    if (lhsType.isFloat() || rhsType.isFloat())
+    {
+        unsigned bits = std::max(lhsType.isFloat() ? lhsType.bits : 0, rhsType.isFloat() ? rhsType.bits : 0);
+        return ValueType(ValueType::Float, bits, true);
+    }
+
+    if (lhsType.bits != rhsType.bits)
+        return lhsType.bits > rhsType.bits ? lhsType : rhsType;
+
+    return ValueType(ValueType::Integer, lhsType.bits, lhsType.isSigned && rhsType.isSigned);
+}
+
+// Report calls of void functions and free used where a value is needed
+void TypeChecker::checkValue(Expression &expression)
+{
+    MethodCall *call = dynamic_cast<MethodCall *>(&expression);
+
+    if (expression.valueType.kind != ValueType::Void || call == NULL)
+        return;
+
+    bool isVoidCall = call->isBuiltin ? call->id.name == "free" && call->arguments.size() == 1 : signatures.find(call->id.name) != signatures.end();
+    if (isVoidCall)
+        error("Function " + call->id.name + " returns no value.");
+}
+
+// Wrap expression in conversion to given type, literals are retyped in place
+Expression *TypeChecker::convert(Expression *expression, const ValueType &type)
+{
+    if (expression->valueType.kind == ValueType::Void && type.kind != ValueType::Void)
+        checkValue(*expression);
+
+    // Other void expressions already reported their error
+    if (expression->valueType == type || type.kind == ValueType::Void || expression->valueType.kind == ValueType::Void)
+        return expression;
+
+    // Untyped memory from alloc is sized for the buffer it is assigned to
+    MethodCall *call = dynamic_cast<MethodCall *>(expression);
+    if (call != NULL && call->isBuiltin && call->id.name == "alloc" && type.isPointer())
+    {
+        expression->valueType = type;
+        return expression;
+    }
+
+    if (expression->valueType.kind == ValueType::String || type.kind == ValueType::String || expression->valueType.isPointer() || type.isPointer())
+    {
+        error("Cannot convert " + expression->valueType.name() + " to " + type.name() + ".");
+        return expression;
+    }
+
+    if ((dynamic_cast<Integer *>(expression) != NULL && type.isInteger()) || (dynamic_cast<Double *>(expression) != NULL && type.isFloat()))
+    {
+        expression->valueType = type;
+        return expression;
+    }
+
+    return new Conversion(expression, type);
+}
+
+void Identifier::checkTypes(TypeChecker &checker)
+{
+    if (!checker.lookup(name, valueType))
+        checker.error("Variable " + name + " is undeclared.");
+}
+
+void MethodCall::checkTypes(TypeChecker &checker)
+{
+    if (id.name == "print" && checker.signatures.find(id.name) == checker.signatures.end())
+    {
+        for (Expression *&argument : arguments)
+            argument->checkTypes(checker);
+
+        // Variadic arguments follow C promotion rules
+        for (Expression *&argument : arguments)
+        {
+            ValueType argumentType = argument->valueType;
+            checker.checkValue(*argument);
+
+            if (argumentType.kind == ValueType::Bool || (argumentType.isInteger() && argumentType.bits < 32))
+                argument = checker.convert(argument, ValueType(ValueType::Integer, 32, argumentType.isSigned));
+            else if (argumentType.isFloat() && argumentType.bits < 64)
+                argument = checker.convert(argument, ValueType::fromName("Double"));
+        }
+
+        valueType = ValueType::fromName("Int32");
+        return;
+    }
+
+    if ((id.name == "alloc" || id.name == "free") && checker.signatures.find(id.name) == checker.signatures.end())
+    {
+        checkBuiltin(checker);
+        return;
+    }
+
+    FunctionSignature *signature = checkArguments(checker);
+
+    if (signature == NULL)
+        return;
+
+    if (signature->isGenerator)
+        checker.error("Generator " + id.name + " can only be consumed by loop [x in " + id.name + "(...)].");
+
+    valueType = signature->returnType;
+}
+
+// alloc(count) gives memory for count elements of the buffer it is assigned to, free(buffer) returns it
+void MethodCall::checkBuiltin(TypeChecker &checker)
+{
+    isBuiltin = true;
+
+    for (Expression *&argument : arguments)
+        argument->checkTypes(checker);
+
+    if (arguments.size() != 1)
+    {
+        checker.error("Function " + id.name + " expects 1 argument.");
+        return;
+    }
+
+    if (id.name == "free")
+    {
+        if (!arguments[0]->valueType.isPointer())
+            checker.error("Function free expects a buffer, got " + arguments[0]->valueType.name() + ".");
+
+        valueType = ValueType(ValueType::Void);
+        return;
+    }
+
+    if (!arguments[0]->valueType.isInteger())
+        checker.error("Function alloc expects element count, got " + arguments[0]->valueType.name() + ".");
+    else
+        arguments[0] = checker.convert(arguments[0], ValueType::fromName("Int"));
+
+    valueType = ValueType::pointerTo(ValueType(ValueType::Void));
+}
+
+FunctionSignature *MethodCall::checkArguments(TypeChecker &checker)
+{
+    for (Expression *&argument : arguments)
+        argument->checkTypes(checker);
+
+    if (checker.signatures.find(id.name) == checker.signatures.end())
+    {
+        checker.error("Function " + id.name + " is undefined.");
+        return NULL;
+    }
+
+    FunctionSignature &signature = checker.signatures[id.name];
+
+    if (signature.argumentTypes.size() != arguments.size())
+        checker.error("Function " + id.name + " expects " + std::to_string(signature.argumentTypes.size()) + " arguments.");
+
+    for (size_t i = 0; i < arguments.size() && i < signature.argumentTypes.size(); i++)
+        arguments[i] = checker.convert(arguments[i], signature.argumentTypes[i]);
+
+    return &signature;
+}
+
+void BinaryOperator::checkTypes(TypeChecker &checker)
+{
+    lhs->checkTypes(checker);
+    rhs->checkTypes(checker);
+
+    ValueType operandType = checker.commonType(*lhs, *rhs);
+
+    if (!operandType.isNumeric())
+    {
+        checker.error("Operator is not defined for " + lhs->valueType.name() + " and " + rhs->valueType.name() + ".");
+        return;
+    }
+
+    if (op == POWER_OP)
+        checker.error("Operator ^ is not supported.");
+
+    lhs = checker.convert(lhs, operandType);
+    rhs = checker.convert(rhs, operandType);
+
+    switch (op)
+    {
+    case EQ:
+    case NEQ:
+    case LT:
+    case GT:
+    case LTE:
+    case GTE:
+        valueType = ValueType(ValueType::Bool, 1);
+        break;
+    default:
+        valueType = operandType;
+        break;
+    }
+}
+
+void UnaryOperator::checkTypes(TypeChecker &checker)
+{
+    exp->checkTypes(checker);
+    valueType = exp->valueType;
+
+    if (!valueType.isNumeric())
+        checker.error("Operator is not defined for " + valueType.name() + ".");
+}
+
+void InversionOperator::checkTypes(TypeChecker &checker)
+{
+    rhs.checkTypes(checker);
+    valueType = rhs.valueType;
+
+    if (dynamic_cast<Integer *>(&rhs) == NULL && dynamic_cast<String *>(&rhs) == NULL)
+        checker.error("Inversion is only defined for integer and string literals.");
+}
+
+void Assignment::checkTypes(TypeChecker &checker)
+{
+    rhs->checkTypes(checker);
+
+    if (!checker.lookup(lhs.name, valueType))
+    {
+        checker.error("Variable " + lhs.name + " is undeclared.");
+        return;
+    }
+
+    rhs = checker.convert(rhs, valueType);
+}
+
+// Type of buffer variable indexed by element access, Void when it is not a buffer
+static ValueType bufferType(TypeChecker &checker, const std::string &name, Expression *&index)
+{
+    ValueType type;
+    index->checkTypes(checker);
+
+    if (!checker.lookup(name, type))
+    {
+        checker.error("Variable " + name + " is undeclared.");
+        return ValueType(ValueType::Void);
+    }
+
+    if (!type.isPointer())
+    {
+        checker.error("Variable " + name + " of type " + type.name() + " cannot be indexed.");
+        return ValueType(ValueType::Void);
+    }
+
+    if (!index->valueType.isInteger())
+        checker.error("Index of " + name + " must be an integer, got " + index->valueType.name() + ".");
+    else
+        index = checker.convert(index, ValueType::fromName("Int"));
+
+    return type;
+}
+
+void ElementAccess::checkTypes(TypeChecker &checker)
+{
+    ValueType type = bufferType(checker, id.name, index);
+
+    if (type.isPointer())
+        valueType = type.element();
+}
+
+void ElementAssignment::checkTypes(TypeChecker &checker)
+{
+    ValueType type = bufferType(checker, id.name, index);
+    rhs->checkTypes(checker);
+
+    if (!type.isPointer())
+        return;
+
+    valueType = type.element();
+    rhs = checker.convert(rhs, valueType);
+}
+
+void Block::checkTypes(TypeChecker &checker)
+{
+    for (Statement *statement : statements)
+        statement->checkTypes(checker);
+}
+
+void ExpressionStatement::checkTypes(TypeChecker &checker)
+{
+    expression.checkTypes(checker);
+}
+
+void VariableDeclaration::checkTypes(TypeChecker &checker)
+{
+    ValueType variableType = checker.typeOf(type.name);
+
+    if (type.name == "void")
+        checker.error("Variable " + id.name + " cannot be void.");
+
+    checker.declare(id.name, variableType);
+
+    if (assignmentExpression != NULL)
+    {
+        assignmentExpression->checkTypes(checker);
+        assignmentExpression = checker.convert(assignmentExpression, variableType);
+    }
+}
+
+// Statement of type T anywhere in block, except in nested function declarations
+template <class T>
+static bool containsStatement(Block &block)
+{
+    for (Statement *statement : block.statements)
+    {
+        if (dynamic_cast<T *>(statement) != NULL)
+            return true;
+
+        Conditional *conditional = dynamic_cast<Conditional *>(statement);
+        if (conditional != NULL && (containsStatement<T>(*conditional->thenBlockNode) || (conditional->elseBlockNode != nullptr && containsStatement<T>(*conditional->elseBlockNode))))
+            return true;
+
+        While *loop = dynamic_cast<While *>(statement);
+        if (loop != NULL && containsStatement<T>(*loop->body))
+            return true;
+
+        GeneratorLoop *generatorLoop = dynamic_cast<GeneratorLoop *>(statement);
+        if (generatorLoop != NULL && containsStatement<T>(*generatorLoop->body))
+            return true;
+
+        ParallelLoop *parallelLoop = dynamic_cast<ParallelLoop *>(statement);
+        if (parallelLoop != NULL && containsStatement<T>(*parallelLoop->body))
+            return true;
+
+        Region *region = dynamic_cast<Region *>(statement);
+        if (region != NULL && containsStatement<T>(*region->body))
+            return true;
+
+        if (Match *match = dynamic_cast<Match *>(statement))
+            for (MatchCase *matchCase : match->cases)
+                if (containsStatement<T>(*matchCase->body))
+                    return true;
+    }
+
+    return false;
+}
+
+static bool containsYield(Block &block)
+{
+    return containsStatement<YieldStatement>(block);
+}
+
+void FunctionDeclaration::checkSignature(TypeChecker &checker)
+{
+    FunctionSignature signature;
+    signature.returnType = checker.typeOf(type.name);
+    signature.isGenerator = isGenerator = containsYield(block);
+
+    if (isGenerator && type.name == "void")
+        checker.error("Generator " + id.name + " must declare type of yielded values.");
+
+    // Generated code calls runtime by these names
+    if (id.name.compare(0, 8, "iridium_") == 0)
+        checker.error("Function name " + id.name + " is reserved for the runtime.");
+
+    for (VariableDeclaration *argument : arguments)
+        signature.argumentTypes.push_back(checker.typeOf(argument->type.name));
+
+    checker.signatures[id.name] = signature;
+}
+
+void FunctionDeclaration::checkTypes(TypeChecker &checker)
+{
+    // Registered before body is checked, so function can call itself
+    if (checker.signatures.find(id.name) == checker.signatures.end())
+        checkSignature(checker);
+
+    FunctionSignature &signature = checker.signatures[id.name];
+    ValueType enclosingReturnType = checker.returnType;
+    bool enclosingGenerator = checker.insideGenerator;
+    checker.returnType = signature.returnType;
+    checker.insideGenerator = signature.isGenerator;
+    checker.pushScope(false);
+
+    for (VariableDeclaration *argument : arguments)
+        argument->checkTypes(checker);
+
+    block.checkTypes(checker);
+
+    checker.popScope();
+    checker.returnType = enclosingReturnType;
+    checker.insideGenerator = enclosingGenerator;
+}
+
+void Conditional::checkTypes(TypeChecker &checker)
+{
+    comparison->checkTypes(checker);
+    comparison = checker.convert(comparison, ValueType(ValueType::Bool, 1));
+
+    checker.pushScope(true);
+    thenBlockNode->checkTypes(checker);
+    checker.popScope();
+
+    if (elseBlockNode != nullptr)
+    {
+        checker.pushScope(true);
+        elseBlockNode->checkTypes(checker);
+        checker.popScope();
+    }
+}
+
+// Value of integer constant used as case bound, negative literals are scanned as Double
+static bool caseConstant(Expression *expression, long long &value)
+{
+    if (Integer *integer = dynamic_cast<Integer *>(expression))
+    {
+        value = integer->value;
+        return true;
+    }
+
+    Double *number = dynamic_cast<Double *>(expression);
+    if (number == NULL || number->value != (double)(long long)number->value)
+        return false;
+
+    value = (long long)number->value;
+    return true;
+}
+
+static std::string describeRange(const CaseRange &range)
+{
+    if (range.lowValue == range.highValue)
+        return std::to_string(range.lowValue);
+
+    return std::to_string(range.lowValue) + ".." + std::to_string(range.highValue);
+}
+
+// Values of type that case constants can name, UInt64 values above Int64 cannot be written
+static void valueBounds(const ValueType &type, long long &lowest, long long &highest)
+{
+    if (type.kind == ValueType::Bool)
+    {
+        lowest = 0;
+        highest = 1;
+    }
+    else if (type.isSigned)
+    {
+        lowest = type.bits == 64 ? LLONG_MIN : -(1LL << (type.bits - 1));
+        highest = type.bits == 64 ? LLONG_MAX : (1LL << (type.bits - 1)) - 1;
+    }
+    else
+    {
+        lowest = 0;
+        highest = type.bits == 64 ? LLONG_MAX : (1LL << type.bits) - 1;
+    }
+}
+
+/*
+    Cases become one switch, so no value may be matched by two of them.
+    Without `_` case every value of subject type has to be covered, then
+    switch needs no default and no range check.
+*/
+void Match::checkTypes(TypeChecker &checker)
+{
+    subject->checkTypes(checker);
+
+    ValueType type = subject->valueType;
+    bool isMatchable = type.isInteger() || type.kind == ValueType::Bool;
+    long long lowest = 0;
+    long long highest = 0;
+    MatchCase *defaultCase = NULL;
+    std::vector<CaseRange *> ranges;
+
+    if (isMatchable)
+        valueBounds(type, lowest, highest);
+    else
+        checker.error("Match is only defined for integers and Bool, got " + type.name() + ".");
+
+    for (MatchCase *matchCase : cases)
+    {
+        for (CaseRange *range : matchCase->ranges)
+        {
+            Identifier *wildcard = dynamic_cast<Identifier *>(range->low);
+
+            if (wildcard != NULL && wildcard->name != "_")
+                checker.error("Case pattern " + wildcard->name + " is not a constant, a range or _.");
+            else if (wildcard != NULL && matchCase->ranges.size() != 1)
+                checker.error("Case _ cannot be combined with other patterns.");
+            else if (wildcard != NULL && defaultCase != NULL)
+                checker.error("Match has more than one _ case.");
+            else if (wildcard != NULL)
+                defaultCase = matchCase;
+            else if (!caseConstant(range->low, range->lowValue) || !caseConstant(range->high, range->highValue))
+                checker.error("Case pattern must be an integer constant.");
+            else if (range->lowValue > range->highValue)
+                checker.error("Case " + describeRange(*range) + " is empty.");
+            else if (isMatchable && (range->lowValue < lowest || range->highValue > highest))
+                checker.error("Case " + describeRange(*range) + " is out of range of " + type.name() + ".");
+            else
+                ranges.push_back(range);
+        }
+
+        matchCase->isDefault = matchCase == defaultCase;
+
+        checker.pushScope(true);
+        matchCase->body->checkTypes(checker);
+        checker.popScope();
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](const CaseRange *a, const CaseRange *b) {
+        return a->lowValue < b->lowValue;
+    });
+
+    // Range reaching furthest so far, later ranges starting inside it overlap
+    CaseRange *furthest = NULL;
+    for (CaseRange *range : ranges)
+    {
+        if (furthest != NULL && range->lowValue <= furthest->highValue)
+            checker.error("Case " + describeRange(*range) + " overlaps case " + describeRange(*furthest) + ".");
+
+        if (furthest == NULL || range->highValue > furthest->highValue)
+            furthest = range;
+    }
+
+    if (defaultCase != NULL || !isMatchable)
+        return;
+
+    long long uncovered = lowest;
+    bool coversHighest = false;
+
+    for (CaseRange *range : ranges)
+    {
+        if (range->lowValue > uncovered)
+            break;
+
+        if (range->highValue >= highest)
+        {
+            coversHighest = true;
+            break;
+        }
+
+        uncovered = std::max(uncovered, range->highValue + 1);
+    }
+
+    bool beyondConstants = type.isInteger() && !type.isSigned && type.bits == 64;
+    if (coversHighest && !beyondConstants)
+        return;
+
+    std::string missing = coversHighest ? std::to_string((unsigned long long)LLONG_MAX + 1) : std::to_string(uncovered);
+    checker.error("Match is not exhaustive, " + missing + " is not covered by any case.");
+}
+
+void ReturnStatement::checkTypes(TypeChecker &checker)
+{
+    if (checker.insideGenerator)
+        checker.error("Generator cannot return a value, its sequence ends with the function body.");
+
+    returnExpression->checkTypes(checker);
+
+    // Top level code and void functions have nothing to return a value to
+    if (checker.returnType.kind == ValueType::Void && !checker.insideGenerator)
+    {
+        checker.error("Only functions with a return type can return a value.");
+        return;
+    }
+
+    returnExpression = checker.convert(returnExpression, checker.returnType);
+}
+
+void YieldStatement::checkTypes(TypeChecker &checker)
+{
+    yieldExpression->checkTypes(checker);
+
+    if (!checker.insideGenerator)
+    {
+        checker.error("Yield is only allowed in function body.");
+        return;
+    }
+
+    yieldExpression = checker.convert(yieldExpression, checker.returnType);
+}
+
+void GeneratorLoop::checkTypes(TypeChecker &checker)
+{
+    MethodCall *call = dynamic_cast<MethodCall *>(sequence);
+    FunctionSignature *signature = call != NULL ? call->checkArguments(checker) : NULL;
+
+    if (call == NULL)
+        checker.error("Loop over " + id.name + " needs a generator call.");
+    else if (signature != NULL && !signature->isGenerator)
+        checker.error("Function " + call->id.name + " is not a generator.");
+
+    if (signature != NULL)
+        elementType = sequence->valueType = signature->returnType;
+
+    checker.pushScope(true);
+    checker.declare(id.name, elementType);
+    body->checkTypes(checker);
+    checker.popScope();
+}
+
+void While::checkTypes(TypeChecker &checker)
+{
+    // Loop variable stays visible after the loop, like in generated code
+    if (loopVariable != nullptr)
+        loopVariable->checkTypes(checker);
+
+    comparison->checkTypes(checker);
+    comparison = checker.convert(comparison, ValueType(ValueType::Bool, 1));
+
+    checker.pushScope(true);
+    body->checkTypes(checker);
+
+    if (postLoop != nullptr)
+        postLoop->checkTypes(checker);
+
+    checker.popScope();
+}
+
+// Recognizes `i = i + <step>` and `i++` parallel loop steps
+static bool parallelStep(Statement *postLoop, const std::string &name, long long &step)
+{
+    ExpressionStatement *statement = dynamic_cast<ExpressionStatement *>(postLoop);
+    if (statement == NULL)
+        return false;
+
+    Expression *expression = &statement->expression;
+    if (Assignment *assignment = dynamic_cast<Assignment *>(expression))
+    {
+        if (assignment->lhs.name != name)
+            return false;
+        expression = assignment->rhs;
+    }
+
+    if (UnaryOperator *unary = dynamic_cast<UnaryOperator *>(expression))
+    {
+        Identifier *counter = dynamic_cast<Identifier *>(unary->exp);
+        step = 1;
+        return unary->op == INC_OP && counter != NULL && counter->name == name;
+    }
+
+    BinaryOperator *binary = dynamic_cast<BinaryOperator *>(expression);
+    if (binary == NULL || binary->op != PLUS_OP)
+        return false;
+
+    Identifier *counter = dynamic_cast<Identifier *>(binary->lhs);
+    Integer *increment = dynamic_cast<Integer *>(binary->rhs);
+    if (counter == NULL || increment == NULL || counter->name != name || increment->value <= 0)
+        return false;
+
+    step = increment->value;
+    return true;
+}
+
+void ParallelLoop::checkTypes(TypeChecker &checker)
+{
+    // Body runs in outlined function, which cannot suspend enclosing generator or return from it
+    if (containsYield(*body))
+        checker.error("Yield is not allowed in parallel loop.");
+    if (containsStatement<ReturnStatement>(*body))
+        checker.error("Return is not allowed inside parallel loop.");
+
+    checker.pushScope(true);
+    loopVariable->checkTypes(checker);
+    comparison->checkTypes(checker);
+
+    // Checked after typing, bound converted to Double no longer compares the counter itself
+    VariableDeclaration *induction = dynamic_cast<VariableDeclaration *>(loopVariable);
+    BinaryOperator *bound = dynamic_cast<BinaryOperator *>(comparison);
+    Identifier *boundCounter = bound != NULL ? dynamic_cast<Identifier *>(bound->lhs) : NULL;
+
+    if (induction == NULL || induction->type.name != "Int" || boundCounter == NULL || boundCounter->name != induction->id.name ||
+        (bound->op != LT && bound->op != LTE) || !parallelStep(postLoop, induction->id.name, step))
+        checker.error("Parallel loop must have form [i : Int = <begin>; i < <end>; i = i + <step>].");
+
+    comparison = checker.convert(comparison, ValueType(ValueType::Bool, 1));
+
+    for (Reduction *reduction : reductions)
+    {
+        ValueType accumulatorType;
+
+        if (!checker.lookup(reduction->id.name, accumulatorType) || (induction != NULL && reduction->id.name == induction->id.name))
+            checker.error("Reduction variable " + reduction->id.name + " is undeclared.");
+        else if (!accumulatorType.isNumeric())
+            checker.error("Reduction variable " + reduction->id.name + " must be numeric.");
+
+        if (reduction->op != "+" && reduction->op != "*" && reduction->op != "min" && reduction->op != "max")
+            checker.error("Unknown reduction operator " + reduction->op + ".");
+    }
+
+    body->checkTypes(checker);
+    postLoop->checkTypes(checker);
+    checker.popScope();
+}
+
+void Region::checkTypes(TypeChecker &checker)
+{
+    // Suspended generator would leave its region open while consumer allocates
+    if (containsYield(*body))
+        checker.error("Yield is not allowed in region.");
+
+    checker.pushScope(true);
+    body->checkTypes(checker);
+    checker.popScope();
+}
@@ -0,0 +1,74 @@
+#include <map>
+#include <string>
+#include <vector>
+#include "types.h"
+
+class Block;
+class Expression;
+
+/**
+ * Source level types of function return value and arguments.
+ */
+class FunctionSignature
+{
+public:
+    ValueType returnType;
+    std::vector<ValueType> argumentTypes;
+    // Returns coroutine handle, return type is type of yielded values
+    bool isGenerator = false;
+};
+
+/**
+ * Type checking pass run over the tree before code generation.
+ * Annotates every expression with its type and wraps operands
+ * in explicit conversions, so code generation never has to guess.
+ */
+class TypeChecker
+{
+    // Visible variables, inner blocks start with a copy of the enclosing scope
+    std::vector<std::map<std::string, ValueType>> scopes;
+    int errorCount = 0;
+
+public:
+    std::map<std::string, FunctionSignature> signatures;
+    ValueType returnType;
+    // Body of generator function is being checked
+    bool insideGenerator = false;
+
+    bool check(Block &root);
+
+    void pushScope(bool inheritVariables)
+    {
+        if (inheritVariables && !scopes.empty())
+            scopes.push_back(scopes.back());
+        else
+            scopes.push_back(std::map<std::string, ValueType>());
+    }
+
+    void popScope()
+    {
+        scopes.pop_back();
+    }
+
+    void declare(const std::string &name, const ValueType &type)
+    {
+        scopes.back()[name] = type;
+    }
+
+    bool lookup(const std::string &name, ValueType &type)
+    {
+        auto variable = scopes.back().find(name);
+
+        if (variable == scopes.back().end())
+            return false;
+
+        type = variable->second;
+        return true;
+    }
+
+    void error(const std::string &message);
+    ValueType typeOf(const std::string &name);
+    ValueType commonType(Expression &lhs, Expression &rhs);
+    void checkValue(Expression &expression);
+    Expression *convert(Expression *expression, const ValueType &type);
+};
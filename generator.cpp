@@ -1,8 +1,23 @@
 #include "ast.h"
 #include "generator.hpp"
 #include "parser.hpp"
+#include "runtime.h"
+#include "target.hpp"
+#include "remarks.hpp"
 #include <algorithm>
+#include <llvm/Analysis/TargetTransformInfo.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Path.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/Transforms/Coroutines.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+
+llvm::LLVMContext llvmContext;
+llvm::IRBuilder<> builder(llvmContext);
 
 /*
     Modules containt functions
@@ -10,34 +25,251 @@
     Basic blocks contains instructions
 */
 
+// Declare runtime library function in module, reusing existing declaration.
+// User functions cannot take iridium_ names, so the declaration found is always the runtime one.
+static llvm::Function *runtimeFunction(GeneratorContext &context, const std::string &name, llvm::FunctionType *functionType)
+{
+    llvm::Function *function = context.module->getFunction(name);
+
+    if (function == NULL)
+        function = llvm::Function::Create(functionType, llvm::GlobalValue::ExternalLinkage, name, context.module);
+
+    return function;
+}
+
+// Make runtime library linked into compiler visible to execution engine
+static void registerRuntimeSymbols()
+{
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_parallel_for", (void *)&iridium_parallel_for);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_parallel_set_workers", (void *)&iridium_parallel_set_workers);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_reduce_lock", (void *)&iridium_reduce_lock);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_reduce_unlock", (void *)&iridium_reduce_unlock);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_cpu_level", (void *)&iridium_cpu_level);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_alloc", (void *)&iridium_alloc);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_free", (void *)&iridium_free);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_region_enter", (void *)&iridium_region_enter);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_region_leave", (void *)&iridium_region_leave);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_frame_alloc", (void *)&iridium_frame_alloc);
+    llvm::sys::DynamicLibrary::AddSymbol("iridium_frame_free", (void *)&iridium_frame_free);
+}
+
+// Set fast-math flags on every floating point instruction of the module
+static void applyFastMath(llvm::Module &module)
+{
+    llvm::FastMathFlags flags;
+    flags.setFast();
+
+    for (llvm::Function &function : module)
+    {
+        if (function.isDeclaration())
+            continue;
+
+        // Backend counterpart of instruction flags
+        function.addFnAttr("unsafe-fp-math", "true");
+        function.addFnAttr("no-nans-fp-math", "true");
+        function.addFnAttr("no-infs-fp-math", "true");
+        function.addFnAttr("no-signed-zeros-fp-math", "true");
+
+        for (llvm::BasicBlock &block : function)
+            for (llvm::Instruction &instruction : block)
+                if (llvm::isa<llvm::FPMathOperator>(instruction))
+                    instruction.setFastMathFlags(flags);
+    }
+}
+
+// Run -O2 pipeline tuned for target machine, reporting what optimizer did and why it did not when asked
+void GeneratorContext::optimizeModule(llvm::TargetMachine &targetMachine)
+{
+    this->logMessage("Running optimizer.");
+
+    // Context owns collector
+    RemarkCollector *collector = nullptr;
+    if (options.remarks)
+    {
+        collector = new RemarkCollector();
+        llvmContext.setDiagnosticHandler(std::unique_ptr<llvm::DiagnosticHandler>(collector));
+    }
+
+    llvm::PassManagerBuilder passBuilder;
+    passBuilder.OptLevel = 2;
+    passBuilder.Inliner = llvm::createFunctionInliningPass(2, 0, false);
+    passBuilder.LoopVectorize = true;
+    passBuilder.SLPVectorize = true;
+    targetMachine.adjustPassManager(passBuilder);
+
+    // Splits generators into resume and destroy functions, frames of inlined generators are elided
+    llvm::addCoroutinePassesToExtensionPoints(passBuilder);
+
+    llvm::legacy::FunctionPassManager functionPasses(module);
+    functionPasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    passBuilder.populateFunctionPassManager(functionPasses);
+
+    llvm::legacy::PassManager modulePasses;
+    modulePasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+    passBuilder.populateModulePassManager(modulePasses);
+
+    functionPasses.doInitialization();
+    for (llvm::Function &function : *module)
+        functionPasses.run(function);
+    functionPasses.doFinalization();
+    modulePasses.run(*module);
+
+    if (collector == nullptr)
+        return;
+
+    if (options.remarksFile.empty())
+        printRemarks(collector->remarks, sourceFile);
+    else
+        writeRemarks(collector->remarks, sourceFile, options.remarksFile);
+
+    collector->remarks.clear();
+}
+
 void GeneratorContext::compileToExecutable(std::string fileName)
 {
+    llvm::TargetMachine *targetMachine = configureTarget(*this->module, options.targetCPU);
+
+    if (targetMachine == nullptr)
+        return;
+
+    // Clones are optimized for their own feature level
+    if (options.multiversion)
+        multiversionFunctions(*this->module);
+
+    // Generators are lowered by coroutine passes, which only run as part of optimizer
+    optimizeModule(*targetMachine);
+
+    delete targetMachine;
+
     std::error_code EC;
     llvm::raw_fd_ostream OS(fileName, EC, llvm::sys::fs::F_None);
     WriteBitcodeToFile(*this->module, OS);
     OS.flush();
 }
 
+// Create subprogram of function, so its instructions can carry source locations
+void GeneratorContext::attachDebugInfo(llvm::Function *function, Node &node)
+{
+    llvm::DISubroutineType *subroutineType = debugBuilder->createSubroutineType(debugBuilder->getOrCreateTypeArray(llvm::None));
+    unsigned line = node.span.firstLine;
+    llvm::DISubprogram *subprogram = debugBuilder->createFunction(debugFile, function->getName(), llvm::StringRef(), debugFile, line, subroutineType, function->hasInternalLinkage(), true, line);
+    function->setSubprogram(subprogram);
+}
+
+// Locate instructions emitted in current function since previous statement boundary
+void GeneratorContext::setDebugLocation(Node &node)
+{
+    if (blocks.empty() || currentBlock() == NULL || node.span.firstLine == 0)
+        return;
+
+    llvm::Function *function = currentBlock()->getParent();
+    if (function == NULL || function->getSubprogram() == NULL)
+        return;
+
+    llvm::DILocation *location = llvm::DILocation::get(llvmContext, node.span.firstLine, node.span.firstColumn, function->getSubprogram());
+
+    std::vector<llvm::BasicBlock *> &unfinished = unfinishedBlocks[function];
+    llvm::BasicBlock *&lastSeen = lastSeenBlock[function];
+
+    // Blocks are appended to function, ones created since previous boundary follow the last one seen
+    llvm::Function::iterator created = lastSeen == nullptr ? function->begin() : std::next(lastSeen->getIterator());
+    for (; created != function->end(); created++)
+        unfinished.push_back(&*created);
+
+    if (!function->empty())
+        lastSeen = &function->back();
+
+    // Instructions are appended to blocks, so only the tail after the last located one is new.
+    // Terminated block is finished, allocas put at the front of entry block get declaration line when module is finished.
+    size_t kept = 0;
+    for (llvm::BasicBlock *block : unfinished)
+    {
+        for (auto it = block->rbegin(); it != block->rend() && !it->getDebugLoc(); it++)
+            it->setDebugLoc(location);
+
+        if (block->getTerminator() == NULL)
+            unfinished[kept++] = block;
+    }
+
+    unfinished.resize(kept);
+}
+
+// Instructions emitted before nested statement starts belong to the enclosing one
+void GeneratorContext::beginStatement(Node &statement)
+{
+    if (!openStatements.empty())
+        setDebugLocation(*openStatements.back());
+
+    openStatements.push_back(&statement);
+}
+
+void GeneratorContext::endStatement()
+{
+    setDebugLocation(*openStatements.back());
+    openStatements.pop_back();
+}
+
 // Create LLVM module object
-void GeneratorContext::compileModule(Block &root)
+void GeneratorContext::compileModule(Block &root, const std::string &sourceFile)
 {
     this->logMessage("Running code generation.");
+    this->sourceFile = sourceFile;
+
+    // Line tables only, enough for profilers and optimization remarks
+    debugBuilder = new llvm::DIBuilder(*module);
+    debugFile = debugBuilder->createFile(llvm::sys::path::filename(sourceFile), llvm::sys::path::parent_path(sourceFile));
+    debugBuilder->createCompileUnit(llvm::dwarf::DW_LANG_C, debugFile, "Iridium", false, "", 0, "", llvm::DICompileUnit::LineTablesOnly);
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
 
     // Argument types list for start function
     std::vector<llvm::Type *> argumentTypes;
 
-    // Create void return type for function
-    llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), llvm::makeArrayRef(argumentTypes), false);
+    // Create int return type for function, it is exit status of the executable
+    llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::Type::getInt32Ty(llvmContext), llvm::makeArrayRef(argumentTypes), false);
 
     // Create main function of given type.
-    mainFunction = llvm::Function::Create(functionType, llvm::GlobalValue::InternalLinkage, "main", module);
+    mainFunction = llvm::Function::Create(functionType, llvm::GlobalValue::ExternalLinkage, "main", module);
     llvm::BasicBlock *block = llvm::BasicBlock::Create(llvmContext, "entry", mainFunction, 0);
+    attachDebugInfo(mainFunction, root);
 
     pushBlock(block, "Main function basic block");
+
+    // Top level functions can be called before they are defined
+    for (Statement *statement : root.statements)
+        if (FunctionDeclaration *function = dynamic_cast<FunctionDeclaration *>(statement))
+            function->generatePrototype(*this);
+
+    if (options.workerCount > 0)
+    {
+        llvm::Type *int64Type = llvm::Type::getInt64Ty(llvmContext);
+        llvm::FunctionType *setWorkersType = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), llvm::makeArrayRef(int64Type), false);
+        llvm::CallInst::Create(runtimeFunction(*this, "iridium_parallel_set_workers", setWorkersType), llvm::makeArrayRef<llvm::Value *>(llvm::ConstantInt::get(int64Type, options.workerCount)), "", block);
+    }
+
     root.generateCode(*this);
-    llvm::ReturnInst::Create(llvmContext, this->currentBlock());
+    llvm::ReturnInst::Create(llvmContext, llvm::ConstantInt::get(functionType->getReturnType(), 0), this->currentBlock());
     popBlock();
 
+    // Instructions outside of any statement belong to function declaration line
+    for (llvm::Function &function : *module)
+    {
+        llvm::DISubprogram *subprogram = function.getSubprogram();
+        if (subprogram == NULL)
+            continue;
+
+        llvm::DILocation *location = llvm::DILocation::get(llvmContext, subprogram->getLine(), 0, subprogram);
+        for (llvm::BasicBlock &functionBlock : function)
+            for (llvm::Instruction &instruction : functionBlock)
+                if (!instruction.getDebugLoc())
+                    instruction.setDebugLoc(location);
+    }
+
+    debugBuilder->finalize();
+
+    if (options.fastMath)
+        applyFastMath(*module);
+
     llvm::legacy::PassManager passManager;
 
     if (verboseOutput)
@@ -51,9 +283,23 @@ void GeneratorContext::compileModule(Block &root)
 llvm::GenericValue GeneratorContext::runCode()
 {
     this->logMessage("Running code.");
+    registerRuntimeSymbols();
+
+    // Code is compiled for the machine it runs on, so every host feature can be used
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+
+    if (options.multiversion)
+        this->logMessage("Multiversioning is not needed for JIT, ignored.");
+
+    llvm::TargetMachine *targetMachine = configureTarget(*module, "native");
+    if (targetMachine != nullptr)
+        optimizeModule(*targetMachine);
+    delete targetMachine;
 
     // Process module with execution engine
-    llvm::ExecutionEngine *executionEngine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(module)).create();
+    llvm::ExecutionEngine *executionEngine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(module)).setMCPU(hostCPUName()).setMAttrs(hostCPUFeatures()).create();
     executionEngine->finalizeObject();
 
     // Run code in main function
@@ -62,29 +308,78 @@ llvm::GenericValue GeneratorContext::runCode()
     return functionValue;
 }
 
+// Return LLVM type of source level type
+static llvm::Type *llvmTypeOf(const ValueType &type)
+{
+    switch (type.kind)
+    {
+    case ValueType::Bool:
+        return llvm::Type::getInt1Ty(llvmContext);
+    case ValueType::Integer:
+        return llvm::Type::getIntNTy(llvmContext, type.bits);
+    case ValueType::Float:
+        return type.bits == 32 ? llvm::Type::getFloatTy(llvmContext) : llvm::Type::getDoubleTy(llvmContext);
+    case ValueType::String:
+        return llvm::Type::getInt8PtrTy(llvmContext);
+    case ValueType::Pointer:
+        return type.elementKind == ValueType::Void ? llvm::Type::getInt8PtrTy(llvmContext) : llvmTypeOf(type.element())->getPointerTo();
+    default:
+        return llvm::Type::getVoidTy(llvmContext);
+    }
+}
+
 // Return LLVM type from given identifier
 static llvm::Type *typeOf(const Identifier &type)
 {
-    if (type.name.compare("Int") == 0)
-        return llvm::Type::getInt64Ty(llvmContext);
-    else if (type.name.compare("Double") == 0)
-        return llvm::Type::getDoubleTy(llvmContext);
-    else if (type.name.compare("String") == 0)
-        return llvm::Type::getInt8PtrTy(llvmContext);
+    return llvmTypeOf(ValueType::fromName(type.name));
+}
+
+// Convert value between source level types, integers are extended by sign of the source type
+static llvm::Value *convertValue(llvm::IRBuilder<> &builder, llvm::Value *value, const ValueType &from, const ValueType &to)
+{
+    if (value == NULL || from == to || to.kind == ValueType::Void)
+        return value;
+
+    llvm::Type *targetType = llvmTypeOf(to);
+
+    if (from.kind == ValueType::String || to.kind == ValueType::String)
+    {
+        std::cerr << "Cannot convert " << from.name() << " to " << to.name() << "." << std::endl;
+        return value;
+    }
+
+    if (to.kind == ValueType::Bool)
+    {
+        if (from.isFloat())
+            return builder.CreateFCmpUNE(value, llvm::ConstantFP::get(value->getType(), 0.0));
+        return builder.CreateICmpNE(value, llvm::ConstantInt::get(value->getType(), 0));
+    }
+
+    if (from.kind == ValueType::Bool)
+        return to.isFloat() ? builder.CreateUIToFP(value, targetType) : builder.CreateZExt(value, targetType);
 
-    return llvm::Type::getVoidTy(llvmContext);
+    if (from.isInteger() && to.isInteger())
+        return from.isSigned ? builder.CreateSExtOrTrunc(value, targetType) : builder.CreateZExtOrTrunc(value, targetType);
+
+    if (from.isInteger())
+        return from.isSigned ? builder.CreateSIToFP(value, targetType) : builder.CreateUIToFP(value, targetType);
+
+    if (to.isInteger())
+        return to.isSigned ? builder.CreateFPToSI(value, targetType) : builder.CreateFPToUI(value, targetType);
+
+    return builder.CreateFPCast(value, targetType);
 }
 
 // Return ConstantInt of specified integer.
 llvm::Value *Integer::generateCode(GeneratorContext &context)
 {
-    return llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), value, true);
+    return llvm::ConstantInt::get(llvmTypeOf(valueType), value, valueType.isSigned);
 }
 
 // Return ConstantFP of specified integer.
 llvm::Value *Double::generateCode(GeneratorContext &context)
 {
-    return llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvmContext), value);
+    return llvm::ConstantFP::get(llvmTypeOf(valueType), value);
 }
 
 llvm::Value *String::generateCode(GeneratorContext &context)
@@ -136,8 +431,46 @@ llvm::Value *Identifier::generateCode(GeneratorContext &context)
     return new llvm::LoadInst(context.locals()[name], "", false, context.currentBlock());
 }
 
+// alloc sizes memory by element of buffer it is assigned to, untyped alloc counts bytes
+static llvm::Value *generateBuiltinCall(GeneratorContext &context, MethodCall &call)
+{
+    llvm::Type *bytePointerType = llvm::Type::getInt8PtrTy(llvmContext);
+    llvm::Type *int64Type = llvm::Type::getInt64Ty(llvmContext);
+    llvm::Value *argument = call.arguments[0]->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+
+    if (call.id.name == "free")
+    {
+        llvm::FunctionType *freeType = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), bytePointerType, false);
+        return builder.CreateCall(runtimeFunction(context, "iridium_free", freeType), builder.CreateBitCast(argument, bytePointerType));
+    }
+
+    ValueType element = call.valueType.element();
+    llvm::Value *size = argument;
+
+    // Overflowing byte count is passed as negative, which runtime rejects like a negative count
+    if (element.kind != ValueType::Void)
+    {
+        llvm::Function *multiply = llvm::Intrinsic::getDeclaration(context.module, llvm::Intrinsic::smul_with_overflow, int64Type);
+        llvm::Value *multiplyArguments[] = {argument, llvm::ConstantExpr::getSizeOf(llvmTypeOf(element))};
+        llvm::Value *product = builder.CreateCall(multiply, multiplyArguments);
+        size = builder.CreateSelect(builder.CreateExtractValue(product, 1), builder.getInt64(-1), builder.CreateExtractValue(product, 0));
+    }
+
+    // Fresh memory aliases nothing else, like malloc
+    llvm::FunctionType *allocType = llvm::FunctionType::get(bytePointerType, int64Type, false);
+    llvm::Function *allocFunction = runtimeFunction(context, "iridium_alloc", allocType);
+    allocFunction->addAttribute(llvm::AttributeList::ReturnIndex, llvm::Attribute::NoAlias);
+
+    llvm::Value *memory = builder.CreateCall(allocFunction, size, "buffer");
+    return builder.CreateBitCast(memory, llvmTypeOf(call.valueType));
+}
+
 llvm::Value *MethodCall::generateCode(GeneratorContext &context)
 {
+    if (isBuiltin)
+        return generateBuiltinCall(context, *this);
+
     // Get function by name from module
     llvm::StringRef functionName = llvm::StringRef(id.name);
     llvm::Function *function = context.module->getFunction(functionName);
@@ -169,79 +502,93 @@ llvm::Value *MethodCall::generateCode(GeneratorContext &context)
         functionArguments.push_back((**it).generateCode(context));
 
     llvm::CallInst *functionCall = llvm::CallInst::Create(function, llvm::makeArrayRef(functionArguments), "", context.currentBlock());
+    functionCall->setCallingConv(function->getCallingConv());
     context.logMessage("Created function " + id.name);
     return functionCall;
 }
 
+// Operands are already converted to common type by type checker
 llvm::Value *BinaryOperator::generateCode(GeneratorContext &context)
 {
-    llvm::Instruction::BinaryOps instruction;
+    llvm::Value *lhsValue = lhs->generateCode(context);
+    llvm::Value *rhsValue = rhs->generateCode(context);
     llvm::IRBuilder<> builder(context.currentBlock());
-    llvm::Value *lhsValue = lhs.generateCode(context);
-    llvm::Value *rhsValue = rhs.generateCode(context);
+
+    ValueType operandType = lhs->valueType;
+    bool isFloat = operandType.isFloat();
+    // Signed overflow is undefined, unsigned arithmetic wraps
+    bool noSignedWrap = operandType.isInteger() && operandType.isSigned;
 
     switch (op)
     {
     // Arithmetic operators
     case PLUS_OP:
-        instruction = llvm::Instruction::Add;
-        break;
+        return isFloat ? builder.CreateFAdd(lhsValue, rhsValue) : builder.CreateAdd(lhsValue, rhsValue, "", false, noSignedWrap);
     case MINUS_OP:
-        instruction = llvm::Instruction::Sub;
-        break;
+        return isFloat ? builder.CreateFSub(lhsValue, rhsValue) : builder.CreateSub(lhsValue, rhsValue, "", false, noSignedWrap);
     case MUL_OP:
-        instruction = llvm::Instruction::Mul;
-        break;
+        return isFloat ? builder.CreateFMul(lhsValue, rhsValue) : builder.CreateMul(lhsValue, rhsValue, "", false, noSignedWrap);
     case DIV_OP:
-        instruction = llvm::Instruction::SDiv;
-        break;
+        if (isFloat)
+            return builder.CreateFDiv(lhsValue, rhsValue);
+        return operandType.isSigned ? builder.CreateSDiv(lhsValue, rhsValue) : builder.CreateUDiv(lhsValue, rhsValue);
     case MOD_OP:
-        instruction = llvm::Instruction::SRem;
+        if (isFloat)
+            return builder.CreateFRem(lhsValue, rhsValue);
+        return operandType.isSigned ? builder.CreateSRem(lhsValue, rhsValue) : builder.CreateURem(lhsValue, rhsValue);
+    default:
         break;
+    }
+
     // Comparison operators
+    llvm::CmpInst::Predicate predicate;
+
+    switch (op)
+    {
     case EQ:
-        return builder.CreateICmpEQ(lhsValue, rhsValue);
+        predicate = isFloat ? llvm::CmpInst::FCMP_OEQ : llvm::CmpInst::ICMP_EQ;
+        break;
+    case NEQ:
+        predicate = isFloat ? llvm::CmpInst::FCMP_UNE : llvm::CmpInst::ICMP_NE;
+        break;
     case LT:
-        return builder.CreateICmpSLT(lhsValue, rhsValue);
+        predicate = isFloat ? llvm::CmpInst::FCMP_OLT : operandType.isSigned ? llvm::CmpInst::ICMP_SLT : llvm::CmpInst::ICMP_ULT;
+        break;
     case GT:
-        return builder.CreateICmpSGT(lhsValue, rhsValue);
+        predicate = isFloat ? llvm::CmpInst::FCMP_OGT : operandType.isSigned ? llvm::CmpInst::ICMP_SGT : llvm::CmpInst::ICMP_UGT;
+        break;
     case LTE:
-        return builder.CreateICmpSLE(lhsValue, rhsValue);
+        predicate = isFloat ? llvm::CmpInst::FCMP_OLE : operandType.isSigned ? llvm::CmpInst::ICMP_SLE : llvm::CmpInst::ICMP_ULE;
+        break;
     case GTE:
-        return builder.CreateICmpSGE(lhsValue, rhsValue);
-    case NEQ:
-        return builder.CreateICmpNE(lhsValue, rhsValue);
+        predicate = isFloat ? llvm::CmpInst::FCMP_OGE : operandType.isSigned ? llvm::CmpInst::ICMP_SGE : llvm::CmpInst::ICMP_UGE;
+        break;
     //case OR: 
     //    return builder.CreateOr(lhsValue, rhsValue);
     default:
         return NULL;
-        break;
     }
 
-    return llvm::BinaryOperator::Create(instruction, lhsValue, rhsValue, "", context.currentBlock());
+    return isFloat ? builder.CreateFCmp(predicate, lhsValue, rhsValue) : builder.CreateICmp(predicate, lhsValue, rhsValue);
 }
 
 llvm::Value *UnaryOperator::generateCode(GeneratorContext &context)
 {
-    uint addressSpace = 64;
-    uint64_t value = 1;
-    llvm::ConstantInt *one = llvm::ConstantInt::get(llvmContext, llvm::APInt(addressSpace, value, false));
-    llvm::Instruction::BinaryOps instruction;
+    llvm::Value *value = exp->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+
+    bool noSignedWrap = valueType.isInteger() && valueType.isSigned;
+    llvm::Value *one = valueType.isFloat() ? llvm::ConstantFP::get(value->getType(), 1.0) : llvm::ConstantInt::get(value->getType(), 1);
 
     switch (op)
     {
     case INC_OP:
-        instruction = llvm::Instruction::Add;
-        break;
+        return valueType.isFloat() ? builder.CreateFAdd(value, one) : builder.CreateAdd(value, one, "", false, noSignedWrap);
     case DEC_OP:
-        instruction = llvm::Instruction::Sub;
-        break;
+        return valueType.isFloat() ? builder.CreateFSub(value, one) : builder.CreateSub(value, one, "", false, noSignedWrap);
     default:
         return NULL;
-        break;
     }
-
-    return llvm::BinaryOperator::Create(instruction, exp.generateCode(context), one, "", context.currentBlock());
 }
 
 llvm::Value *InversionOperator::generateCode(GeneratorContext &context)
@@ -262,13 +609,13 @@ llvm::Value *InversionOperator::generateCode(GeneratorContext &context)
         }
 
         integer->value = reverse;
-        return integer->generateCode(context);
+        invertedValue = integer->generateCode(context);
     }
     else if (dynamic_cast<String *>(&rhs))
     {
         String *string = dynamic_cast<String *>(&rhs);
         std::reverse(string->value.begin(), string->value.end());
-        return string->generateCode(context);
+        invertedValue = string->generateCode(context);
     }
 
     return invertedValue;
@@ -282,7 +629,48 @@ llvm::Value *Assignment::generateCode(GeneratorContext &context)
         return NULL;
     }
     // Save variable in memory.
-    return new llvm::StoreInst(rhs.generateCode(context), context.locals()[lhs.name], false, context.currentBlock());
+    return new llvm::StoreInst(rhs->generateCode(context), context.locals()[lhs.name], false, context.currentBlock());
+}
+
+// Address of buffer element, index is converted to Int by type checker
+static llvm::Value *elementAddress(GeneratorContext &context, const std::string &name, Expression *index)
+{
+    if (context.locals().find(name) == context.locals().end())
+    {
+        std::cerr << "Variable " << name << " is undeclared." << std::endl;
+        return NULL;
+    }
+
+    llvm::Value *storage = context.locals()[name];
+    ValueType bufferType = context.variableType(storage);
+    llvm::Value *indexValue = index->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+    llvm::Value *buffer = builder.CreateLoad(llvmTypeOf(bufferType), storage, name);
+
+    return builder.CreateInBoundsGEP(llvmTypeOf(bufferType.element()), buffer, indexValue);
+}
+
+llvm::Value *ElementAccess::generateCode(GeneratorContext &context)
+{
+    llvm::Value *address = elementAddress(context, id.name, index);
+
+    if (address == NULL)
+        return NULL;
+
+    llvm::IRBuilder<> builder(context.currentBlock());
+    return builder.CreateLoad(llvmTypeOf(valueType), address);
+}
+
+llvm::Value *ElementAssignment::generateCode(GeneratorContext &context)
+{
+    llvm::Value *address = elementAddress(context, id.name, index);
+    llvm::Value *value = rhs->generateCode(context);
+
+    if (address == NULL)
+        return NULL;
+
+    llvm::IRBuilder<> builder(context.currentBlock());
+    return builder.CreateStore(value, address);
 }
 
 llvm::Value *Block::generateCode(GeneratorContext &context)
@@ -294,12 +682,21 @@ llvm::Value *Block::generateCode(GeneratorContext &context)
     {
         std::string statementName = typeid(**it).name();
         context.logMessage("Generating code for " + statementName);
+        context.beginStatement(**it);
         last = (**it).generateCode(context);
+        context.endStatement();
     }
 
     context.logMessage("Block created.");
 }
 
+llvm::Value *Conversion::generateCode(GeneratorContext &context)
+{
+    llvm::Value *value = exp->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+    return convertValue(builder, value, exp->valueType, valueType);
+}
+
 llvm::Value *ExpressionStatement::generateCode(GeneratorContext &context)
 {
     std::string expressionName = typeid(expression).name();
@@ -307,56 +704,341 @@ llvm::Value *ExpressionStatement::generateCode(GeneratorContext &context)
     return expression.generateCode(context);
 }
 
+// Direct call of function with given name
+static MethodCall *callTo(Expression *expression, const std::string &name)
+{
+    MethodCall *call = dynamic_cast<MethodCall *>(expression);
+    return call != NULL && call->id.name == name ? call : NULL;
+}
+
+// Expression without calls can be evaluated earlier without changing behaviour
+static bool isCallFree(Expression *expression)
+{
+    if (dynamic_cast<Identifier *>(expression) != NULL || dynamic_cast<Integer *>(expression) != NULL || dynamic_cast<Double *>(expression) != NULL)
+        return true;
+    if (BinaryOperator *binary = dynamic_cast<BinaryOperator *>(expression))
+        return isCallFree(binary->lhs) && isCallFree(binary->rhs);
+    if (UnaryOperator *unary = dynamic_cast<UnaryOperator *>(expression))
+        return isCallFree(unary->exp);
+    if (Conversion *conversion = dynamic_cast<Conversion *>(expression))
+        return isCallFree(conversion->exp);
+    return false;
+}
+
+// Operand combined with accumulator for `<- x op f(...)`, NULL if return has other form
+static Expression *accumulatedOperand(ReturnStatement &statement, const std::string &name, int op)
+{
+    BinaryOperator *binary = dynamic_cast<BinaryOperator *>(statement.returnExpression);
+
+    if (binary == NULL || binary->op != op)
+        return NULL;
+    if (callTo(binary->rhs, name) != NULL && isCallFree(binary->lhs))
+        return binary->lhs;
+    if (callTo(binary->lhs, name) != NULL && isCallFree(binary->rhs))
+        return binary->rhs;
+    return NULL;
+}
+
+/*
+    Marks returns ending function body or a branch as tail returns.
+    Loop bodies are skipped, return inside them still runs post loop code.
+*/
+static void collectTailReturns(Block &block, std::vector<ReturnStatement *> &tailReturns)
+{
+    for (size_t i = 0; i < block.statements.size(); i++)
+    {
+        Statement *statement = block.statements[i];
+
+        if (Conditional *conditional = dynamic_cast<Conditional *>(statement))
+        {
+            collectTailReturns(*conditional->thenBlockNode, tailReturns);
+            if (conditional->elseBlockNode != nullptr)
+                collectTailReturns(*conditional->elseBlockNode, tailReturns);
+        }
+
+        if (Match *match = dynamic_cast<Match *>(statement))
+            for (MatchCase *matchCase : match->cases)
+                collectTailReturns(*matchCase->body, tailReturns);
+
+        ReturnStatement *returnStatement = dynamic_cast<ReturnStatement *>(statement);
+        if (returnStatement != NULL && i == block.statements.size() - 1)
+        {
+            returnStatement->isTail = true;
+            tailReturns.push_back(returnStatement);
+        }
+    }
+}
+
+static void leaveRegion(GeneratorContext &context, llvm::Value *depth)
+{
+    llvm::Type *int64Type = llvm::Type::getInt64Ty(llvmContext);
+    llvm::FunctionType *leaveType = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), int64Type, false);
+    llvm::CallInst::Create(runtimeFunction(context, "iridium_region_leave", leaveType), depth, "", context.currentBlock());
+}
+
+// Leaving function releases every region open in it, nested ones go with the outermost
+static void leaveOpenRegions(GeneratorContext &context)
+{
+    if (!context.regions.empty())
+        leaveRegion(context, context.regions.front());
+}
+
+// Leaving function also destroys generators of loops it leaves early, innermost first
+static void destroyOpenGenerators(GeneratorContext &context)
+{
+    llvm::Function *destroy = llvm::Intrinsic::getDeclaration(context.module, llvm::Intrinsic::coro_destroy);
+    for (auto it = context.generators.rbegin(); it != context.generators.rend(); it++)
+        llvm::CallInst::Create(destroy, *it, "", context.currentBlock());
+}
+
+// Store new arguments into parameters and jump back to function start
+static void generateTailJump(GeneratorContext &context, MethodCall &call)
+{
+    TailRecursion *recursion = context.tailRecursion;
+    std::vector<llvm::Value *> argumentValues;
+
+    // All arguments are evaluated before any parameter is overwritten
+    for (Expression *argument : call.arguments)
+        argumentValues.push_back(argument->generateCode(context));
+
+    for (size_t i = 0; i < argumentValues.size(); i++)
+        new llvm::StoreInst(argumentValues[i], recursion->parameters[i], false, context.currentBlock());
+
+    destroyOpenGenerators(context);
+    leaveOpenRegions(context);
+    llvm::BranchInst::Create(recursion->header, context.currentBlock());
+
+    // Anything generated after the jump is unreachable
+    llvm::BasicBlock *unreachableBlock = llvm::BasicBlock::Create(llvmContext, "afterTailCall", context.currentBlock()->getParent());
+    context.setCurrentBlock(unreachableBlock, "After tail call", context.currentBlockLocals());
+    context.logMessage("Turned tail call of " + call.id.name + " into loop");
+}
+
+static llvm::Value *accumulate(llvm::IRBuilder<> &builder, int op, llvm::Value *lhs, llvm::Value *rhs)
+{
+    // No wrap flags, reassociation could make overflow appear where original order had none
+    if (lhs->getType()->isFloatingPointTy())
+        return op == PLUS_OP ? builder.CreateFAdd(lhs, rhs) : builder.CreateFMul(lhs, rhs);
+    return op == PLUS_OP ? builder.CreateAdd(lhs, rhs) : builder.CreateMul(lhs, rhs);
+}
+
 // Generates code for return statement
 llvm::Value *ReturnStatement::generateCode(GeneratorContext &context)
 {
-    std::string returnName = typeid(returnExpression).name();
+    std::string returnName = typeid(*returnExpression).name();
     context.logMessage("Generating return code for " + returnName);
 
-    llvm::Value *returnValue = returnExpression.generateCode(context);
+    TailRecursion *recursion = context.tailRecursion;
+
+    if (isTail && recursion != nullptr)
+    {
+        MethodCall *selfCall = callTo(returnExpression, recursion->functionName);
+        Expression *operand = recursion->accumulator != nullptr ? accumulatedOperand(*this, recursion->functionName, recursion->accumulatorOp) : NULL;
+
+        if (selfCall != NULL)
+        {
+            generateTailJump(context, *selfCall);
+            return NULL;
+        }
+
+        if (operand != NULL)
+        {
+            BinaryOperator *binary = dynamic_cast<BinaryOperator *>(returnExpression);
+            llvm::Value *operandValue = operand->generateCode(context);
+            llvm::IRBuilder<> builder(context.currentBlock());
+            llvm::Value *accumulated = builder.CreateLoad(recursion->accumulator->getType()->getPointerElementType(), recursion->accumulator);
+            builder.CreateStore(accumulate(builder, recursion->accumulatorOp, accumulated, operandValue), recursion->accumulator);
+            generateTailJump(context, *callTo(binary->lhs == operand ? binary->rhs : binary->lhs, recursion->functionName));
+            return NULL;
+        }
+    }
+
+    llvm::Value *returnValue = returnExpression->generateCode(context);
+    llvm::CallInst *call = llvm::dyn_cast_or_null<llvm::CallInst>(returnValue);
+    llvm::Function *function = context.currentBlock()->getParent();
+
+    // Result of call is returned right away, callee frame can replace ours, unless regions are left or generators destroyed in between
+    if (isTail && call != NULL && dynamic_cast<MethodCall *>(returnExpression) != NULL && (recursion == nullptr || recursion->accumulator == nullptr))
+    {
+        llvm::Function *callee = call->getCalledFunction();
+        bool prototypesMatch = callee != NULL && callee->getFunctionType() == function->getFunctionType() && callee->getCallingConv() == function->getCallingConv();
+        call->setTailCallKind(prototypesMatch && context.regions.empty() && context.generators.empty() ? llvm::CallInst::TCK_MustTail : llvm::CallInst::TCK_Tail);
+    }
+
+    if (recursion != nullptr && recursion->accumulator != nullptr && returnValue != NULL)
+    {
+        llvm::IRBuilder<> builder(context.currentBlock());
+        llvm::Value *accumulated = builder.CreateLoad(returnValue->getType(), recursion->accumulator);
+        returnValue = accumulate(builder, recursion->accumulatorOp, accumulated, returnValue);
+    }
+
+    destroyOpenGenerators(context);
+    leaveOpenRegions(context);
     context.setCurrentReturnValue(returnValue);
     return returnValue;
 }
 
 // Generates code for variable declaration
+// Alignment of generator promise, shared by coroutine and its consumers
+static const unsigned promiseAlignment = 8;
+
+static llvm::Function *intrinsic(GeneratorContext &context, llvm::Intrinsic::ID id, llvm::ArrayRef<llvm::Type *> types = llvm::None)
+{
+    return llvm::Intrinsic::getDeclaration(context.module, id, types);
+}
+
+/*
+    Start coroutine of generator function in its entry block. Frame is
+    allocated only when optimizer cannot elide it into caller's frame.
+    Code following it continues in returned block.
+*/
+static llvm::BasicBlock *beginCoroutine(GeneratorContext &context, Coroutine &coroutine, llvm::Function *function, const ValueType &elementType)
+{
+    llvm::Type *bytePointerType = llvm::Type::getInt8PtrTy(llvmContext);
+    llvm::Type *int64Type = llvm::Type::getInt64Ty(llvmContext);
+    llvm::BasicBlock *entryBlock = context.currentBlock();
+    llvm::BasicBlock *allocateBlock = llvm::BasicBlock::Create(llvmContext, "coroutineAllocate", function);
+    llvm::BasicBlock *beginBlock = llvm::BasicBlock::Create(llvmContext, "coroutineBegin", function);
+    llvm::IRBuilder<> builder(entryBlock);
+
+    // Marks function for coroutine splitting passes
+    function->addFnAttr("coroutine.presplit", "0");
+
+    llvm::AllocaInst *promise = builder.CreateAlloca(llvmTypeOf(elementType), nullptr, "promise");
+    promise->setAlignment(promiseAlignment);
+    coroutine.promise = promise;
+
+    llvm::Value *nullPointer = llvm::ConstantPointerNull::get(llvm::Type::getInt8PtrTy(llvmContext));
+    llvm::Value *idArguments[] = {builder.getInt32(promiseAlignment), builder.CreateBitCast(promise, bytePointerType), nullPointer, nullPointer};
+    coroutine.id = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_id), idArguments, "coroutineId");
+    builder.CreateCondBr(builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_alloc), coroutine.id), allocateBlock, beginBlock);
+
+    builder.SetInsertPoint(allocateBlock);
+    llvm::Value *size = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_size, int64Type));
+    llvm::FunctionType *frameAllocType = llvm::FunctionType::get(bytePointerType, int64Type, false);
+    llvm::Value *memory = builder.CreateCall(runtimeFunction(context, "iridium_frame_alloc", frameAllocType), size, "frame");
+    builder.CreateBr(beginBlock);
+
+    builder.SetInsertPoint(beginBlock);
+    llvm::PHINode *frame = builder.CreatePHI(bytePointerType, 2);
+    frame->addIncoming(nullPointer, entryBlock);
+    frame->addIncoming(memory, allocateBlock);
+    llvm::Value *beginArguments[] = {coroutine.id, frame};
+    coroutine.handle = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_begin), beginArguments, "handle");
+
+    // Destroyed coroutine frees its frame, then leaves like a suspended one
+    coroutine.suspend = llvm::BasicBlock::Create(llvmContext, "coroutineSuspend", function);
+    coroutine.cleanup = llvm::BasicBlock::Create(llvmContext, "coroutineCleanup", function);
+
+    builder.SetInsertPoint(coroutine.cleanup);
+    llvm::Value *freeArguments[] = {coroutine.id, coroutine.handle};
+    llvm::Value *freedMemory = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_free), freeArguments);
+    llvm::FunctionType *frameFreeType = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), bytePointerType, false);
+    builder.CreateCall(runtimeFunction(context, "iridium_frame_free", frameFreeType), freedMemory);
+    builder.CreateBr(coroutine.suspend);
+
+    builder.SetInsertPoint(coroutine.suspend);
+    llvm::Value *endArguments[] = {coroutine.handle, builder.getFalse()};
+    builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_end), endArguments);
+    builder.CreateRet(coroutine.handle);
+
+    return beginBlock;
+}
+
+// Suspend coroutine, resuming in returned block, or at final suspend point after which it is done
+static llvm::BasicBlock *suspendCoroutine(GeneratorContext &context, Coroutine &coroutine, bool final)
+{
+    llvm::Function *function = context.currentBlock()->getParent();
+    llvm::IRBuilder<> builder(context.currentBlock());
+    llvm::Value *suspendArguments[] = {llvm::ConstantTokenNone::get(llvmContext), builder.getInt1(final)};
+    llvm::Value *suspended = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_suspend), suspendArguments, "suspended");
+
+    // Resuming from final suspend point is undefined
+    llvm::BasicBlock *resumeBlock = llvm::BasicBlock::Create(llvmContext, final ? "coroutineDone" : "yieldResume", function);
+    llvm::SwitchInst *resumption = builder.CreateSwitch(suspended, coroutine.suspend, 2);
+    resumption->addCase(builder.getInt8(0), resumeBlock);
+    resumption->addCase(builder.getInt8(1), coroutine.cleanup);
+
+    if (final)
+        new llvm::UnreachableInst(llvmContext, resumeBlock);
+
+    return resumeBlock;
+}
+
+llvm::Value *YieldStatement::generateCode(GeneratorContext &context)
+{
+    Coroutine *coroutine = context.coroutine;
+    llvm::Value *value = yieldExpression->generateCode(context);
+    new llvm::StoreInst(value, coroutine->promise, false, context.currentBlock());
+
+    llvm::BasicBlock *resumeBlock = suspendCoroutine(context, *coroutine, false);
+    context.setCurrentBlock(resumeBlock, "Yield resume", context.currentBlockLocals());
+    return NULL;
+}
+
 llvm::Value *VariableDeclaration::generateCode(GeneratorContext &context)
 {
-    unsigned int addressSpace = 64;
+    unsigned int addressSpace = 0;
     const llvm::Twine typeName = llvm::Twine(type.name.c_str());
 
     context.logMessage("Declaring variable [" + id.name + "] of type [" + type.name + "]");
     context.module->print(llvm::outs(), nullptr);
-    llvm::AllocaInst *allocationInstance = new llvm::AllocaInst(typeOf(type), addressSpace, typeName, context.currentBlock());
 
-    context.locals()[id.name] = allocationInstance;
+    // Allocate in entry block, so declarations inside loops do not grow the stack on every iteration
+    ValueType variableType = ValueType::fromName(type.name);
+    llvm::BasicBlock &entryBlock = context.currentBlock()->getParent()->getEntryBlock();
+    llvm::AllocaInst *allocationInstance = entryBlock.empty()
+        ? new llvm::AllocaInst(llvmTypeOf(variableType), addressSpace, typeName, &entryBlock)
+        : new llvm::AllocaInst(llvmTypeOf(variableType), addressSpace, typeName, &entryBlock.front());
+
+    context.declareVariable(id.name, allocationInstance, variableType);
 
     // If declared variable is assigned to something
     if (assignmentExpression != NULL)
     {
-        Assignment assignment(id, *assignmentExpression);
+        Assignment assignment(id, assignmentExpression);
         assignment.generateCode(context);
     }
     return allocationInstance;
 }
 
-// Generates code for function declaration
-llvm::Value *FunctionDeclaration::generateCode(GeneratorContext &context)
+// Generates function declaration, reusing one created ahead of definition
+llvm::Function *FunctionDeclaration::generatePrototype(GeneratorContext &context)
 {
-    const llvm::Twine functionName = llvm::Twine(id.name.c_str());
+    llvm::Function *function = context.module->getFunction(id.name);
+
+    if (function != NULL)
+        return function;
+
     std::vector<llvm::Type *> argumentTypes;
     VariableList::const_iterator it;
 
     for (it = arguments.begin(); it != arguments.end(); it++)
         argumentTypes.push_back(typeOf((**it).type));
 
-    llvm::FunctionType *functionType = llvm::FunctionType::get(typeOf(type), llvm::makeArrayRef(argumentTypes), false);
-    llvm::Function *function = llvm::Function::Create(functionType, llvm::GlobalValue::InternalLinkage, functionName, context.module);
+    // Generator returns handle of its coroutine, yielded values are read from its promise
+    llvm::Type *returnType = isGenerator ? llvm::Type::getInt8PtrTy(llvmContext) : typeOf(type);
+    llvm::FunctionType *functionType = llvm::FunctionType::get(returnType, llvm::makeArrayRef(argumentTypes), false);
+    function = llvm::Function::Create(functionType, llvm::GlobalValue::InternalLinkage, llvm::Twine(id.name.c_str()), context.module);
+
+    // Internal functions share fast calling convention, so tail calls between them can be guaranteed
+    function->setCallingConv(llvm::CallingConv::Fast);
+    return function;
+}
+
+// Generates code for function declaration
+llvm::Value *FunctionDeclaration::generateCode(GeneratorContext &context)
+{
+    VariableList::const_iterator it;
+    llvm::Function *function = generatePrototype(context);
     llvm::BasicBlock *basicBlock = llvm::BasicBlock::Create(llvmContext, "entry", function, 0);
+    context.attachDebugInfo(function, *this);
 
     context.pushBlock(basicBlock, "Basic function block");
 
     llvm::Function::arg_iterator argumentValues = function->arg_begin();
     llvm::Value *argumentValue;
+    TailRecursion recursion;
 
     for (it = arguments.begin(); it != arguments.end(); it++)
     {
@@ -366,11 +1048,96 @@ llvm::Value *FunctionDeclaration::generateCode(GeneratorContext &context)
         argumentValue = &*argumentValues++;
         argumentValue->setName((*it)->id.name.c_str());
         llvm::StoreInst *storeInstance = new llvm::StoreInst(argumentValue, context.locals()[(*it)->id.name], false, basicBlock);
+        recursion.parameters.push_back(context.locals()[(*it)->id.name]);
+    }
+
+    // Self recursive tail calls become jumps to header block following argument stores
+    std::vector<ReturnStatement *> tailReturns;
+    collectTailReturns(block, tailReturns);
+
+    ValueType returnType = ValueType::fromName(type.name);
+    bool isSelfRecursive = false;
+    int accumulatorOp = 0;
+
+    for (ReturnStatement *tailReturn : tailReturns)
+    {
+        isSelfRecursive |= callTo(tailReturn->returnExpression, id.name) != NULL;
+
+        for (int op : {PLUS_OP, MUL_OP})
+        {
+            if (accumulatedOperand(*tailReturn, id.name, op) == NULL)
+                continue;
+            // Floating point results change when reassociated, unless fast math allows it
+            if (returnType.isFloat() && !context.options.fastMath)
+                continue;
+            accumulatorOp = accumulatorOp == 0 || accumulatorOp == op ? op : -1;
+        }
+    }
+
+    recursion.functionName = id.name;
+    TailRecursion *enclosingRecursion = context.tailRecursion;
+    Coroutine *enclosingCoroutine = context.coroutine;
+    std::vector<llvm::Value *> enclosingRegions = context.regions;
+    std::vector<llvm::Value *> enclosingGenerators = context.generators;
+    Coroutine coroutine;
+    context.tailRecursion = nullptr;
+    context.coroutine = nullptr;
+    context.regions.clear();
+    context.generators.clear();
+
+    if (isGenerator)
+    {
+        llvm::BasicBlock *bodyBlock = beginCoroutine(context, coroutine, function, returnType);
+        context.setCurrentBlock(bodyBlock, "Generator body", context.currentBlockLocals());
+        context.coroutine = &coroutine;
+    }
+
+    if (isSelfRecursive || accumulatorOp > 0)
+    {
+        if (accumulatorOp > 0)
+        {
+            llvm::Type *accumulatorType = typeOf(type);
+            recursion.accumulatorOp = accumulatorOp;
+            recursion.accumulator = new llvm::AllocaInst(accumulatorType, 0, "accumulator", basicBlock);
+
+            llvm::Value *identity = returnType.isFloat() ? (llvm::Value *)llvm::ConstantFP::get(accumulatorType, accumulatorOp == MUL_OP ? 1.0 : 0.0) : llvm::ConstantInt::get(accumulatorType, accumulatorOp == MUL_OP ? 1 : 0);
+            new llvm::StoreInst(identity, recursion.accumulator, false, basicBlock);
+        }
+
+        recursion.header = llvm::BasicBlock::Create(llvmContext, "tailRecursion", function);
+        llvm::BranchInst::Create(recursion.header, basicBlock);
+        context.setCurrentBlock(recursion.header, "Tail recursion header", context.currentBlockLocals());
+        context.tailRecursion = &recursion;
     }
 
     block.generateCode(context);
-    llvm::ReturnInst::Create(llvmContext, context.getCurrentReturnValue(), context.currentBlock());
+
+    // Every path already returned when function ends in a branch, falling off the end yields zero
+    llvm::Value *returnValue = context.getCurrentReturnValue();
+    if (returnValue == NULL && !function->getReturnType()->isVoidTy() && !isGenerator)
+    {
+        returnValue = llvm::Constant::getNullValue(function->getReturnType());
+
+        // Implicit zero still ends the chain of accumulated `<- x op f(...)` returns
+        if (recursion.accumulator != nullptr)
+        {
+            llvm::IRBuilder<> builder(context.currentBlock());
+            llvm::Value *accumulated = builder.CreateLoad(returnValue->getType(), recursion.accumulator);
+            returnValue = accumulate(builder, recursion.accumulatorOp, accumulated, returnValue);
+        }
+    }
+
+    // Generator stays suspended at its end until consumer destroys it
+    if (isGenerator)
+        suspendCoroutine(context, coroutine, true);
+    else
+        llvm::ReturnInst::Create(llvmContext, returnValue, context.currentBlock());
+
     context.popBlock();
+    context.tailRecursion = enclosingRecursion;
+    context.coroutine = enclosingCoroutine;
+    context.regions = enclosingRegions;
+    context.generators = enclosingGenerators;
 
     context.logMessage("Created function " + id.name);
     return function;
@@ -429,6 +1196,97 @@ llvm::Value *Conditional::generateCode(GeneratorContext &context)
     return NULL;
 }
 
+// Ranges up to this many values are listed in switch, longer ones are tested before it
+static const unsigned long long maximumListedRange = 256;
+
+/*
+    Cases become one switch, backend lowers it to jump table, bit tests or
+    binary search. Listed ranges of one case are clustered back into range
+    checks by the backend. Exhaustive match without `_` never takes the
+    default, so switch needs no bounds check.
+*/
+llvm::Value *Match::generateCode(GeneratorContext &context)
+{
+    llvm::Function *function = context.currentBlock()->getParent();
+    std::map<std::string, llvm::Value *> locals = context.currentBlockLocals();
+
+    llvm::Value *subjectValue = subject->generateCode(context);
+    llvm::IntegerType *subjectType = llvm::cast<llvm::IntegerType>(subjectValue->getType());
+    llvm::IRBuilder<> builder(context.currentBlock());
+
+    std::vector<llvm::BasicBlock *> caseBlocks;
+    llvm::BasicBlock *defaultBlock = NULL;
+    llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(llvmContext, "matchMerge");
+
+    for (MatchCase *matchCase : cases)
+    {
+        caseBlocks.push_back(llvm::BasicBlock::Create(llvmContext, matchCase->isDefault ? "matchDefault" : "matchCase", function));
+        if (matchCase->isDefault)
+            defaultBlock = caseBlocks.back();
+    }
+
+    if (defaultBlock == NULL)
+    {
+        defaultBlock = llvm::BasicBlock::Create(llvmContext, "matchUnreachable", function);
+        new llvm::UnreachableInst(llvmContext, defaultBlock);
+    }
+
+    // Subject is in long range when subject - low <= high - low, compared unsigned
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        for (CaseRange *range : cases[i]->ranges)
+        {
+            unsigned long long width = (unsigned long long)range->highValue - (unsigned long long)range->lowValue;
+
+            if (cases[i]->isDefault || width < maximumListedRange)
+                continue;
+
+            llvm::Value *offset = builder.CreateSub(subjectValue, llvm::ConstantInt::get(subjectType, range->lowValue, range->lowValue < 0));
+            llvm::Value *inRange = builder.CreateICmpULE(offset, llvm::ConstantInt::get(subjectType, width));
+            llvm::BasicBlock *nextBlock = llvm::BasicBlock::Create(llvmContext, "matchRange", function);
+            builder.CreateCondBr(inRange, caseBlocks[i], nextBlock);
+            builder.SetInsertPoint(nextBlock);
+        }
+    }
+
+    llvm::SwitchInst *dispatch = builder.CreateSwitch(subjectValue, defaultBlock);
+
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        for (CaseRange *range : cases[i]->ranges)
+        {
+            unsigned long long width = (unsigned long long)range->highValue - (unsigned long long)range->lowValue;
+
+            if (cases[i]->isDefault || width >= maximumListedRange)
+                continue;
+
+            for (unsigned long long offset = 0; offset <= width; offset++)
+            {
+                long long value = range->lowValue + (long long)offset;
+                dispatch->addCase(llvm::ConstantInt::get(subjectType, value, value < 0), caseBlocks[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+        context.pushBlock(caseBlocks[i], "Match case", locals);
+        cases[i]->body->generateCode(context);
+
+        if (context.getCurrentReturnValue() != nullptr)
+            llvm::ReturnInst::Create(llvmContext, context.getCurrentReturnValue(), context.currentBlock());
+        else
+            llvm::BranchInst::Create(mergeBlock, context.currentBlock());
+
+        context.popBlock();
+    }
+
+    function->getBasicBlockList().push_back(mergeBlock);
+    context.setCurrentBlock(mergeBlock, "Merge block", locals);
+
+    return nullptr;
+}
+
 llvm::Value *While::generateCode(GeneratorContext &context)
 {
     //get current function
@@ -472,4 +1330,271 @@ llvm::Value *While::generateCode(GeneratorContext &context)
     context.setCurrentBlock(mergeBlock, "Merge block", locals);
 
     return nullptr;
-}
\ No newline at end of file
+}
+
+/*
+    Calling generator runs it up to its first yield. Body reads yielded
+    value from coroutine promise and resumes it, until it is done.
+*/
+llvm::Value *GeneratorLoop::generateCode(GeneratorContext &context)
+{
+    llvm::Function *function = context.currentBlock()->getParent();
+    std::map<std::string, llvm::Value *> locals = context.currentBlockLocals();
+    llvm::Type *elementLLVMType = llvmTypeOf(elementType);
+
+    llvm::BasicBlock *conditionBlock = llvm::BasicBlock::Create(llvmContext, "generatorCondition", function);
+    llvm::BasicBlock *bodyBlock = llvm::BasicBlock::Create(llvmContext, "generator", function);
+    llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(llvmContext, "generatorMerge", function);
+
+    llvm::BasicBlock &entryBlock = function->getEntryBlock();
+    llvm::AllocaInst *element = entryBlock.empty()
+        ? new llvm::AllocaInst(elementLLVMType, 0, id.name, &entryBlock)
+        : new llvm::AllocaInst(elementLLVMType, 0, id.name, &entryBlock.front());
+
+    llvm::Value *handle = sequence->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+    builder.CreateBr(conditionBlock);
+
+    builder.SetInsertPoint(conditionBlock);
+    llvm::Value *done = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_done), handle, "done");
+    builder.CreateCondBr(done, mergeBlock, bodyBlock);
+
+    builder.SetInsertPoint(bodyBlock);
+    llvm::Value *promiseArguments[] = {handle, builder.getInt32(promiseAlignment), builder.getFalse()};
+    llvm::Value *promise = builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_promise), promiseArguments);
+    promise = builder.CreateBitCast(promise, elementLLVMType->getPointerTo());
+    builder.CreateStore(builder.CreateLoad(elementLLVMType, promise), element);
+
+    context.generators.push_back(handle);
+    context.pushBlock(bodyBlock, "GeneratorBody", locals);
+    context.declareVariable(id.name, element, elementType);
+    body->generateCode(context);
+    builder.SetInsertPoint(context.currentBlock());
+    context.generators.pop_back();
+
+    // Return already destroyed generator
+    if (context.getCurrentReturnValue() != nullptr)
+        builder.CreateRet(context.getCurrentReturnValue());
+    else
+    {
+        builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_resume), handle);
+        builder.CreateBr(conditionBlock);
+    }
+
+    context.popBlock();
+    context.setCurrentBlock(mergeBlock, "Merge block", locals);
+    builder.SetInsertPoint(mergeBlock);
+    builder.CreateCall(intrinsic(context, llvm::Intrinsic::coro_destroy), handle);
+
+    return nullptr;
+}
+
+// Neutral starting value of reduction accumulator
+static llvm::Constant *reductionIdentity(const std::string &op, const ValueType &type)
+{
+    llvm::Type *llvmType = llvmTypeOf(type);
+
+    if (type.isFloat())
+    {
+        if (op == "min" || op == "max")
+            return llvm::ConstantFP::getInfinity(llvmType, op == "max");
+        return llvm::ConstantFP::get(llvmType, op == "*" ? 1.0 : 0.0);
+    }
+
+    if (op == "min")
+        return llvm::ConstantInt::get(llvmContext, type.isSigned ? llvm::APInt::getSignedMaxValue(type.bits) : llvm::APInt::getMaxValue(type.bits));
+    if (op == "max")
+        return llvm::ConstantInt::get(llvmContext, type.isSigned ? llvm::APInt::getSignedMinValue(type.bits) : llvm::APInt::getMinValue(type.bits));
+    return llvm::ConstantInt::get(llvmType, op == "*" ? 1 : 0, type.isSigned);
+}
+
+static llvm::Value *reductionCombine(llvm::IRBuilder<> &builder, const std::string &op, const ValueType &type, llvm::Value *lhs, llvm::Value *rhs)
+{
+    bool floating = type.isFloat();
+    bool noSignedWrap = type.isInteger() && type.isSigned;
+
+    if (op == "+")
+        return floating ? builder.CreateFAdd(lhs, rhs) : builder.CreateAdd(lhs, rhs, "", false, noSignedWrap);
+    if (op == "*")
+        return floating ? builder.CreateFMul(lhs, rhs) : builder.CreateMul(lhs, rhs, "", false, noSignedWrap);
+
+    llvm::Value *lessThan = floating ? builder.CreateFCmpOLT(lhs, rhs) : type.isSigned ? builder.CreateICmpSLT(lhs, rhs) : builder.CreateICmpULT(lhs, rhs);
+    return op == "min" ? builder.CreateSelect(lessThan, lhs, rhs) : builder.CreateSelect(lessThan, rhs, lhs);
+}
+
+/*
+    Parallel loop body is outlined into function(first, last, step, environment)
+    running one chunk of iterations. Environment is an array of pointers to
+    every local visible at the loop, reductions accumulate into chunk private
+    copies which are merged into the shared variable under the runtime lock.
+*/
+llvm::Value *ParallelLoop::generateCode(GeneratorContext &context)
+{
+    // Form of header and reductions is verified by type checker
+    VariableDeclaration *induction = dynamic_cast<VariableDeclaration *>(loopVariable);
+    BinaryOperator *bound = dynamic_cast<BinaryOperator *>(comparison);
+    std::map<std::string, llvm::Value *> locals = context.currentBlockLocals();
+    locals.erase(induction->id.name);
+
+    llvm::Type *voidType = llvm::Type::getVoidTy(llvmContext);
+    llvm::Type *int64Type = llvm::Type::getInt64Ty(llvmContext);
+    llvm::Type *bytePointerType = llvm::Type::getInt8PtrTy(llvmContext);
+    llvm::Function *function = context.currentBlock()->getParent();
+
+    // Bounds are evaluated once, before iterations are handed to the runtime
+    llvm::Value *beginValue = induction->assignmentExpression != NULL ? induction->assignmentExpression->generateCode(context) : llvm::ConstantInt::get(int64Type, 0, true);
+    llvm::Value *endValue = bound->rhs->generateCode(context);
+    llvm::IRBuilder<> builder(context.currentBlock());
+
+    if (bound->op == LTE)
+        endValue = builder.CreateAdd(endValue, llvm::ConstantInt::get(int64Type, 1, true));
+
+    // Environment lives in entry block so enclosing loops do not grow the stack
+    std::vector<std::string> captured;
+    for (auto &local : locals)
+        captured.push_back(local.first);
+
+    llvm::ArrayType *environmentType = llvm::ArrayType::get(bytePointerType, captured.size());
+    llvm::IRBuilder<> entryBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
+    llvm::Value *environment = entryBuilder.CreateAlloca(environmentType, nullptr, "parallelEnvironment");
+
+    for (size_t i = 0; i < captured.size(); i++)
+    {
+        llvm::Value *slot = builder.CreateConstGEP2_32(environmentType, environment, 0, i);
+        builder.CreateStore(builder.CreateBitCast(locals[captured[i]], bytePointerType), slot);
+    }
+
+    // Outlined chunk function
+    llvm::Type *bodyArgumentTypes[] = {int64Type, int64Type, int64Type, bytePointerType};
+    llvm::FunctionType *bodyType = llvm::FunctionType::get(voidType, bodyArgumentTypes, false);
+    llvm::Function *bodyFunction = llvm::Function::Create(bodyType, llvm::GlobalValue::InternalLinkage, function->getName() + ".parallel", context.module);
+    context.attachDebugInfo(bodyFunction, *this);
+
+    llvm::Function::arg_iterator argumentValues = bodyFunction->arg_begin();
+    llvm::Value *firstValue = &*argumentValues++;
+    llvm::Value *lastValue = &*argumentValues++;
+    llvm::Value *stepValue = &*argumentValues++;
+    llvm::Value *environmentValue = &*argumentValues++;
+    firstValue->setName("first");
+    lastValue->setName("last");
+    stepValue->setName("step");
+    environmentValue->setName("environment");
+
+    llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(llvmContext, "entry", bodyFunction);
+    llvm::BasicBlock *conditionBlock = llvm::BasicBlock::Create(llvmContext, "parallelCondition", bodyFunction);
+    llvm::BasicBlock *bodyBlock = llvm::BasicBlock::Create(llvmContext, "parallel", bodyFunction);
+    llvm::BasicBlock *mergeBlock = llvm::BasicBlock::Create(llvmContext, "parallelMerge", bodyFunction);
+
+    llvm::IRBuilder<> bodyBuilder(entryBlock);
+    std::map<std::string, llvm::Value *> bodyLocals;
+    llvm::Value *bodyEnvironment = bodyBuilder.CreateBitCast(environmentValue, environmentType->getPointerTo());
+
+    for (size_t i = 0; i < captured.size(); i++)
+    {
+        llvm::Value *slot = bodyBuilder.CreateConstGEP2_32(environmentType, bodyEnvironment, 0, i);
+        llvm::Value *pointer = bodyBuilder.CreateLoad(bytePointerType, slot);
+        bodyLocals[captured[i]] = bodyBuilder.CreateBitCast(pointer, locals[captured[i]]->getType(), captured[i]);
+        context.variableTypes[bodyLocals[captured[i]]] = context.variableType(locals[captured[i]]);
+    }
+
+    std::vector<llvm::Value *> sharedAccumulators;
+    for (Reduction *reduction : reductions)
+    {
+        llvm::Value *shared = bodyLocals[reduction->id.name];
+        ValueType accumulatorType = context.variableType(shared);
+        llvm::Value *accumulator = bodyBuilder.CreateAlloca(llvmTypeOf(accumulatorType), nullptr, reduction->id.name + ".private");
+
+        bodyBuilder.CreateStore(reductionIdentity(reduction->op, accumulatorType), accumulator);
+        sharedAccumulators.push_back(shared);
+        bodyLocals[reduction->id.name] = accumulator;
+        context.variableTypes[accumulator] = accumulatorType;
+    }
+
+    llvm::Value *counter = bodyBuilder.CreateAlloca(int64Type, nullptr, induction->id.name);
+    bodyBuilder.CreateStore(firstValue, counter);
+    bodyLocals[induction->id.name] = counter;
+    context.variableTypes[counter] = ValueType::fromName("Int");
+    bodyBuilder.CreateBr(conditionBlock);
+
+    llvm::IRBuilder<> conditionBuilder(conditionBlock);
+    llvm::Value *conditionValue = conditionBuilder.CreateICmpSLT(conditionBuilder.CreateLoad(int64Type, counter), lastValue);
+    conditionBuilder.CreateCondBr(conditionValue, bodyBlock, mergeBlock);
+
+    // Regions and generators of enclosing function belong to the thread that entered them
+    std::vector<llvm::Value *> enclosingRegions = context.regions;
+    std::vector<llvm::Value *> enclosingGenerators = context.generators;
+    context.regions.clear();
+    context.generators.clear();
+    context.pushBlock(bodyBlock, "ParallelBody", bodyLocals);
+    body->generateCode(context);
+
+    llvm::IRBuilder<> stepBuilder(context.currentBlock());
+    stepBuilder.CreateStore(stepBuilder.CreateAdd(stepBuilder.CreateLoad(int64Type, counter), stepValue), counter);
+    stepBuilder.CreateBr(conditionBlock);
+    context.popBlock();
+    context.regions = enclosingRegions;
+    context.generators = enclosingGenerators;
+
+    // Merge chunk results into shared accumulators
+    llvm::IRBuilder<> mergeBuilder(mergeBlock);
+    if (!reductions.empty())
+    {
+        llvm::FunctionType *lockType = llvm::FunctionType::get(voidType, false);
+        mergeBuilder.CreateCall(runtimeFunction(context, "iridium_reduce_lock", lockType));
+
+        for (size_t i = 0; i < reductions.size(); i++)
+        {
+            llvm::Value *shared = sharedAccumulators[i];
+            ValueType accumulatorType = context.variableType(shared);
+            llvm::Value *partial = mergeBuilder.CreateLoad(llvmTypeOf(accumulatorType), bodyLocals[reductions[i]->id.name]);
+            llvm::Value *total = mergeBuilder.CreateLoad(llvmTypeOf(accumulatorType), shared);
+            mergeBuilder.CreateStore(reductionCombine(mergeBuilder, reductions[i]->op, accumulatorType, total, partial), shared);
+        }
+
+        mergeBuilder.CreateCall(runtimeFunction(context, "iridium_reduce_unlock", lockType));
+    }
+    mergeBuilder.CreateRetVoid();
+
+    // Hand iteration space to the work-stealing runtime
+    llvm::Type *parallelForArgumentTypes[] = {int64Type, int64Type, int64Type, bodyType->getPointerTo(), bytePointerType};
+    llvm::FunctionType *parallelForType = llvm::FunctionType::get(voidType, parallelForArgumentTypes, false);
+    llvm::Value *parallelForArguments[] = {beginValue, endValue, llvm::ConstantInt::get(int64Type, step, true), bodyFunction, builder.CreateBitCast(environment, bytePointerType)};
+    builder.CreateCall(runtimeFunction(context, "iridium_parallel_for", parallelForType), parallelForArguments);
+
+    context.logMessage("Created parallel loop " + bodyFunction->getName().str());
+    return nullptr;
+}
+
+/*
+    Region shares basic block with enclosing code, only its variables are
+    scoped. Return inside body already left the region, code following
+    it is unreachable.
+*/
+llvm::Value *Region::generateCode(GeneratorContext &context)
+{
+    llvm::FunctionType *enterType = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext), false);
+    llvm::Value *depth = llvm::CallInst::Create(runtimeFunction(context, "iridium_region_enter", enterType), "region", context.currentBlock());
+    std::map<std::string, llvm::Value *> locals = context.currentBlockLocals();
+
+    context.regions.push_back(depth);
+    context.pushBlock(context.currentBlock(), "Region", locals);
+    body->generateCode(context);
+
+    llvm::BasicBlock *lastBlock = context.currentBlock();
+    llvm::Value *returnValue = context.getCurrentReturnValue();
+    context.popBlock();
+    context.regions.pop_back();
+
+    context.setCurrentBlock(lastBlock, "After region", locals);
+
+    if (returnValue == NULL)
+    {
+        leaveRegion(context, depth);
+        return nullptr;
+    }
+
+    llvm::ReturnInst::Create(llvmContext, returnValue, lastBlock);
+    llvm::BasicBlock *unreachableBlock = llvm::BasicBlock::Create(llvmContext, "afterRegion", lastBlock->getParent());
+    context.setCurrentBlock(unreachableBlock, "After region", locals);
+    return nullptr;
+}
@@ -8,12 +8,17 @@
 #include <llvm-7/llvm/IR/IRPrintingPasses.h>
 #include <llvm-7/llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm-7/llvm/IR/IRBuilder.h>
+#include <llvm-7/llvm/IR/DIBuilder.h>
+#include <llvm-7/llvm/Target/TargetMachine.h>
 #include <llvm-7/llvm/Support/Casting.h>
+#include "types.h"
 
 class Block;
+class Node;
 
-static llvm::LLVMContext llvmContext;
-static llvm::IRBuilder<> builder(llvmContext);
+// Shared by every translation unit, module and the code generated into it must use one context
+extern llvm::LLVMContext llvmContext;
+extern llvm::IRBuilder<> builder;
 
 /**
  * Code block which contains basi block type from LLVM,
@@ -28,28 +33,104 @@ public:
     std::string blockName;
 };
 
+/**
+ * Self recursion of function being generated. Tail calls to itself store
+ * arguments into parameter variables and jump back to loop header.
+ */
+class TailRecursion
+{
+public:
+    std::string functionName;
+    llvm::BasicBlock *header;
+    std::vector<llvm::Value *> parameters;
+    // Running result of `<- x op f(...)` returns, op is PLUS_OP or MUL_OP
+    llvm::Value *accumulator = nullptr;
+    int accumulatorOp = 0;
+};
+
+/**
+ * Generator function being generated. Yield stores value into promise
+ * and suspends, suspend and cleanup blocks are shared by all yields.
+ */
+class Coroutine
+{
+public:
+    llvm::Value *id;
+    llvm::Value *handle;
+    llvm::Value *promise;
+    llvm::BasicBlock *suspend;
+    llvm::BasicBlock *cleanup;
+};
+
+/**
+ * Command line options affecting code generation.
+ */
+class GeneratorOptions
+{
+public:
+    bool verboseOutput = false;
+    // Worker threads for parallel loops, 0 leaves the choice to the runtime
+    int workerCount = 0;
+    // Let optimizer reassociate floating point math, ignoring NaN, infinity and signed zero
+    bool fastMath = false;
+    // CPU executable is compiled for, "native" for host, empty for generic baseline
+    std::string targetCPU;
+    // Compile functions with loops for several x86-64 feature levels, chosen at load time
+    bool multiversion = false;
+    // Report optimizer remarks against source lines, as YAML when file name is set
+    bool remarks = false;
+    std::string remarksFile;
+};
+
 class GeneratorContext
 {
     std::stack<GeneratorBlock *> blocks;
     llvm::Function *mainFunction;
     bool verboseOutput;
     int logNumber = 0;
+    // Line table of generated code
+    llvm::DIBuilder *debugBuilder = nullptr;
+    llvm::DIFile *debugFile = nullptr;
+    std::string sourceFile;
+    // Statements being generated, innermost last
+    std::vector<Node *> openStatements;
+    // Per function, blocks that can still get instructions and the last block already seen
+    std::map<llvm::Function *, std::vector<llvm::BasicBlock *>> unfinishedBlocks;
+    std::map<llvm::Function *, llvm::BasicBlock *> lastSeenBlock;
+
+    void optimizeModule(llvm::TargetMachine &targetMachine);
 
 public:
     // Compilation unit, containing functions
     llvm::Module *module;
-
-    GeneratorContext(bool verboseOutput)
+    GeneratorOptions options;
+    // Source level types of variable storage
+    std::map<llvm::Value *, ValueType> variableTypes;
+    // Function being generated, when its tail calls to itself become loops
+    TailRecursion *tailRecursion = nullptr;
+    // Generator function being generated
+    Coroutine *coroutine = nullptr;
+    // Depths returned by iridium_region_enter for regions open in function being generated, outermost first
+    std::vector<llvm::Value *> regions;
+    // Handles of generators consumed by loops open in function being generated, outermost first
+    std::vector<llvm::Value *> generators;
+
+    GeneratorContext(GeneratorOptions options) : options(options)
     {
         module = new llvm::Module("main", llvmContext);
-        this->verboseOutput = verboseOutput;
+        this->verboseOutput = options.verboseOutput;
     }
 
-    void compileModule(Block &root);
+    void compileModule(Block &root, const std::string &sourceFile);
     void compileToExecutable(std::string fileName);
 
     llvm::GenericValue runCode();
 
+    void attachDebugInfo(llvm::Function *function, Node &node);
+    void setDebugLocation(Node &node);
+    void beginStatement(Node &statement);
+    void endStatement();
+
     std::map<std::string, llvm::Value *> &locals()
     {
         return blocks.top()->locals;
@@ -68,6 +149,17 @@ public:
         blocks.top()->locals = locals;
     }
 
+    void declareVariable(const std::string &name, llvm::Value *storage, ValueType type)
+    {
+        blocks.top()->locals[name] = storage;
+        variableTypes[storage] = type;
+    }
+
+    ValueType variableType(llvm::Value *storage)
+    {
+        return variableTypes[storage];
+    }
+
     std::map<std::string, llvm::Value *> currentBlockLocals()
     {
         return blocks.top()->locals;
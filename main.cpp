@@ -2,23 +2,47 @@
 #include <unistd.h>
 #include "ast.h"
 #include "generator.hpp"
+#include "checker.hpp"
 
 extern Block *program; // AST tree root node pointer
 extern int yyparse();  // Builds parse tree
 extern FILE *yyin;     // Input stream file pointer
 
-bool checkFlags(int argCount, char **arguments, bool *verboseOutput, bool *compileToFile, std::string *fileName)
+bool checkFlags(int argCount, char **arguments, GeneratorOptions *options, bool *compileToFile, std::string *fileName)
 {
     for (int i = 0; i < argCount; i++){
         if (std::strcmp(arguments[i], "-v") == 0){
-            *verboseOutput = true;
+            options->verboseOutput = true;
+        }
+        if (std::strcmp(arguments[i], "--fast-math") == 0){
+            options->fastMath = true;
+        }
+        if (std::strncmp(arguments[i], "--cpu=", 6) == 0){
+            options->targetCPU = arguments[i] + 6;
+        }
+        if (std::strcmp(arguments[i], "--remarks") == 0){
+            options->remarks = true;
+        }
+        if (std::strncmp(arguments[i], "--remarks=", 10) == 0){
+            options->remarks = true;
+            options->remarksFile = arguments[i] + 10;
+        }
+        if (std::strcmp(arguments[i], "--multiversion") == 0){
+            options->multiversion = true;
+        }
+        if (std::strncmp(arguments[i], "--workers=", 10) == 0)
+        {
+            options->workerCount = std::atoi(arguments[i] + 10);
+            if (options->workerCount <= 0){
+                std::cerr << "Worker count must be a positive number!" << std::endl;
+                return false;
+            }
         }
         if (std::strcmp(arguments[i], "-o") == 0)
         {
             *compileToFile = true;
             if(arguments[i+1] != nullptr){
                 *fileName = arguments[i+1];
-                return true;    
             }
             else{
                 std::cerr << "Provide a file name when using -o option!" << std::endl;
@@ -26,26 +50,32 @@ bool checkFlags(int argCount, char **arguments, bool *verboseOutput, bool *compi
             }
         }
     }
+    return true;
 }
 
 int main(int argCount, char **arguments)
 {
-    bool verboseOutput = false;
+    GeneratorOptions options;
     bool compileToFile = false;
     std::string fileName;
-    if(!checkFlags(argCount, arguments, &verboseOutput, &compileToFile, &fileName))
+    if(!checkFlags(argCount, arguments, &options, &compileToFile, &fileName))
         return -1;
-    GeneratorContext context(verboseOutput);
+    GeneratorContext context(options);
 
     // Invalid parameters
     if (argCount < 2)
-        std::cerr << "Use: " << arguments[0] << " <program.ird>" << std::endl;
+        std::cerr << "Use: " << arguments[0] << " <program.ird> [-v] [-o <file>] [--workers=<count>] [--fast-math] [--cpu=native|<name>] [--multiversion] [--remarks[=<file.yaml>]]" << std::endl;
 
     // Compile given files
     for (int i = 1; i < argCount; i++)
     {
-        if (std::strcmp(arguments[i], "-v") == 0)
+        // Skip options and the output file name following -o
+        if (arguments[i][0] == '-')
+        {
+            if (std::strcmp(arguments[i], "-o") == 0)
+                i++;
             continue;
+        }
 
         std::cout << "-----------------------------------------------------------" << std::endl;
         std::cout << "Compiling source file: [" << arguments[i] << "]" << std::endl;
@@ -56,13 +86,19 @@ int main(int argCount, char **arguments)
             continue;
         }
 
-        yyparse();
-        
-        context.compileModule(*program);
+        // Types are checked and conversions inserted before code generation
+        TypeChecker checker;
+        if (yyparse() != 0 || !checker.check(*program))
+        {
+            std::cerr << "Compilation of " << arguments[i] << " failed." << std::endl;
+            continue;
+        }
+
+        context.compileModule(*program, arguments[i]);
         if (compileToFile)
             context.compileToExecutable(fileName);
         else
-            context.runCode(); 
+            context.runCode();
 
     }
-}
\ No newline at end of file
+}
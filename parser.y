@@ -18,11 +18,31 @@
     VariableDeclaration *var_declaration;
     std::vector <VariableDeclaration*> *variables;
     std::vector <Expression*> *expressions;
+    std::vector <Reduction*> *reductions;
+    Reduction *reduction;
+    std::vector <MatchCase*> *cases;
+    MatchCase *match_case;
+    std::vector <CaseRange*> *ranges;
+    CaseRange *range;
     std::string *string;
     int token;
 }
 
 %error-verbose
+%locations
+
+%code {
+    // Record source span of node created by rule
+    template <class T>
+    T *located(T *node, const YYLTYPE &location)
+    {
+        node->span.firstLine = location.first_line;
+        node->span.firstColumn = location.first_column;
+        node->span.lastLine = location.last_line;
+        node->span.lastColumn = location.last_column;
+        return node;
+    }
+}
 
 %token <string> IDENTIFIER INTEGER DOUBLE STRING    // Variables
 %token <token>  GT LT GTE LTE EQ NEQ ASSIGN         // Comparing
@@ -35,14 +55,21 @@
 %token <token>  AND OR                              // Logical operators
 %token <token>  TYPE_ASSIGN METHOD_RETURN_ARROW     // Misc
 %token <token>  LOOP UNTIL IF ELSE ELSE_IF FUNCTION RETURN VERTICAL_BAR
+%token <token>  PARALLEL REDUCE YIELD IN REGION MATCH RANGE
 
-%type <identifier>  identifier
+%type <identifier>  identifier type_name
 %type <expression>  numbers expression arithmetic_expressions
 %type <variables>   function_arguments
 %type <expressions> call_arguments
+%type <reductions>  reductions reduction_list
+%type <reduction>   reduction
+%type <cases>       match_cases
+%type <match_case>  match_case
+%type <ranges>      case_patterns
+%type <range>       case_pattern
 %type <block>       program statements block
 %type <statement>   statement var_declaration fun_declaration
-%type <statement>   conditional loop
+%type <statement>   conditional loop region match
 %type <token>       comparison
 
 %left PLUS_OP MINUS_OP MUL_OP DIV_OP MOD_OP                    // Operators associativity 
@@ -50,7 +77,7 @@
 %start program
 
 %%
-program : statements { program = $1; }
+program : statements { program = located($1, @$); }
         ;
 
 statements : statement            { $$ = new Block(); $$->statements.push_back($<statement>1); }
@@ -59,51 +86,60 @@ statements : statement            { $$ = new Block(); $$->statements.push_back($
 
 statement : var_declaration 
           | fun_declaration
-          | expression                          { $$ = new ExpressionStatement(*$1); }
+          | expression                          { $$ = located(new ExpressionStatement(*$1), @$); }
           | conditional
           | loop 
-          | RETURN expression                   { $$ = new ReturnStatement(*$2); }   
+          | region
+          | match
+          | RETURN expression                   { $$ = located(new ReturnStatement($2), @$); }   
+          | YIELD expression                    { $$ = located(new YieldStatement($2), @$); }
           ;
 
-block : CURLY_BRACKET_L statements CURLY_BRACKET_R { $$ = $2; }
-      | CURLY_BRACKET_L CURLY_BRACKET_R            { $$ = new Block(); }
+block : CURLY_BRACKET_L statements CURLY_BRACKET_R { $$ = located($2, @$); }
+      | CURLY_BRACKET_L CURLY_BRACKET_R            { $$ = located(new Block(), @$); }
 
-var_declaration : identifier TYPE_ASSIGN identifier                   { $$ = new VariableDeclaration(*$3, *$1); }
-                | identifier TYPE_ASSIGN identifier ASSIGN expression { $$ = new VariableDeclaration(*$3, *$1, $5); }
+var_declaration : identifier TYPE_ASSIGN type_name                   { $$ = located(new VariableDeclaration(*$3, *$1), @$); }
+                | identifier TYPE_ASSIGN type_name ASSIGN expression { $$ = located(new VariableDeclaration(*$3, *$1, $5), @$); }
                 ;
 
-fun_declaration : FUNCTION identifier PAREN_L function_arguments PAREN_R METHOD_RETURN_ARROW identifier block { $$ = new FunctionDeclaration(*$7, *$2, *$4, *$8); delete $4; }
+type_name : identifier
+          | identifier BOX_BRACKET_L BOX_BRACKET_R { $1->name += "[]"; $$ = located($1, @$); }
+          ;
+
+fun_declaration : FUNCTION identifier PAREN_L function_arguments PAREN_R METHOD_RETURN_ARROW type_name block { $$ = located(new FunctionDeclaration(*$7, *$2, *$4, *$8), @$); delete $4; }
                 ;
 
 function_arguments :                                          { $$ = new VariableList(); }
                    | function_arguments var_declaration       { $1->push_back($<var_declaration>2); } 
                    | function_arguments COMMA var_declaration { $1->push_back($<var_declaration>3); } 
 
-identifier : IDENTIFIER { $$ = new Identifier(*$1); delete $1; }
+identifier : IDENTIFIER { $$ = located(new Identifier(*$1), @$); delete $1; }
            ;
 
-numbers : INTEGER { $$ = new Integer(atol($1->c_str())); delete $1; }
-        | DOUBLE  { $$ = new Double(atof($1->c_str())); delete $1; }
-        | STRING  { $$ = new String($1->c_str()); delete $1; }
+numbers : INTEGER { $$ = located(new Integer(atol($1->c_str())), @$); delete $1; }
+        | DOUBLE  { $$ = located(new Double(atof($1->c_str())), @$); delete $1; }
+        | STRING  { $$ = located(new String($1->c_str()), @$); delete $1; }
         ;
 
-arithmetic_expressions : expression INC_OP              { $$ = new UnaryOperator(*$1, $2); } 
-                       | expression DEC_OP              { $$ = new UnaryOperator(*$1, $2); }
-                       | expression PLUS_OP expression  { $$ = new BinaryOperator(*$1, $2, *$3); }
-                       | expression MINUS_OP expression { $$ = new BinaryOperator(*$1, $2, *$3); }
-                       | expression MUL_OP expression   { $$ = new BinaryOperator(*$1, $2, *$3); }
-                       | expression DIV_OP expression   { $$ = new BinaryOperator(*$1, $2, *$3); }
-                       | expression MOD_OP expression   { $$ = new BinaryOperator(*$1, $2, *$3); }
-                       | expression POWER_OP expression { $$ = new BinaryOperator(*$1, $2, *$3); }
+arithmetic_expressions : expression INC_OP              { $$ = located(new UnaryOperator($1, $2), @$); } 
+                       | expression DEC_OP              { $$ = located(new UnaryOperator($1, $2), @$); }
+                       | expression PLUS_OP expression  { $$ = located(new BinaryOperator($1, $2, $3), @$); }
+                       | expression MINUS_OP expression { $$ = located(new BinaryOperator($1, $2, $3), @$); }
+                       | expression MUL_OP expression   { $$ = located(new BinaryOperator($1, $2, $3), @$); }
+                       | expression DIV_OP expression   { $$ = located(new BinaryOperator($1, $2, $3), @$); }
+                       | expression MOD_OP expression   { $$ = located(new BinaryOperator($1, $2, $3), @$); }
+                       | expression POWER_OP expression { $$ = located(new BinaryOperator($1, $2, $3), @$); }
                        ;
 
-expression : identifier ASSIGN expression              { $$ = new Assignment(*$<identifier>1, *$3); }
-           | identifier PAREN_L call_arguments PAREN_R { $$ = new MethodCall(*$1, *$3); delete $3; }
+expression : identifier ASSIGN expression              { $$ = located(new Assignment(*$<identifier>1, $3), @$); }
+           | identifier PAREN_L call_arguments PAREN_R { $$ = located(new MethodCall(*$1, *$3), @$); delete $3; }
+           | identifier BOX_BRACKET_L expression BOX_BRACKET_R ASSIGN expression { $$ = located(new ElementAssignment(*$1, $3, $6), @$); }
+           | identifier BOX_BRACKET_L expression BOX_BRACKET_R { $$ = located(new ElementAccess(*$1, $3), @$); }
            | identifier                                { $<identifier>$ = $1; }
            | numbers                                   
            | arithmetic_expressions
-           | INVERSE_OP expression                     { $$ = new InversionOperator($1, *$2); }                 
-           | expression comparison expression          { $$ = new BinaryOperator(*$1, $2, *$3); }
+           | INVERSE_OP expression                     { $$ = located(new InversionOperator($1, *$2), @$); }                 
+           | expression comparison expression          { $$ = located(new BinaryOperator($1, $2, $3), @$); }
            | PAREN_L expression PAREN_R                { $$ = $2; } 
            ;
 
@@ -111,14 +147,51 @@ call_arguments :                                 { $$ = new ExpressionList(); }
                | expression                      { $$ = new ExpressionList(); $$->push_back($1); }
                | call_arguments COMMA expression { $1->push_back($3); }
 
-conditional : IF BOX_BRACKET_L expression BOX_BRACKET_R block ELSE block    { $$ = new Conditional($3, $5, $7); }
-            | IF BOX_BRACKET_L expression BOX_BRACKET_R block               { $$ = new Conditional($3, $5); }
+conditional : IF BOX_BRACKET_L expression BOX_BRACKET_R block ELSE block    { $$ = located(new Conditional($3, $5, $7), @$); }
+            | IF BOX_BRACKET_L expression BOX_BRACKET_R block               { $$ = located(new Conditional($3, $5), @$); }
             ;
 
-loop : LOOP BOX_BRACKET_L var_declaration SEMICOLON expression SEMICOLON statement BOX_BRACKET_R block {$$ = new While($5, $9, $7, $3); }
-     | LOOP UNTIL BOX_BRACKET_L expression BOX_BRACKET_R block { $$ = new While($4, $6); }
+loop : LOOP BOX_BRACKET_L var_declaration SEMICOLON expression SEMICOLON statement BOX_BRACKET_R block {$$ = located(new While($5, $9, $7, $3), @$); }
+     | LOOP UNTIL BOX_BRACKET_L expression BOX_BRACKET_R block { $$ = located(new While($4, $6), @$); }
+     | LOOP BOX_BRACKET_L identifier IN expression BOX_BRACKET_R block { $$ = located(new GeneratorLoop(*$3, $5, $7), @$); }
+     | PARALLEL LOOP BOX_BRACKET_L var_declaration SEMICOLON expression SEMICOLON statement BOX_BRACKET_R reductions block { $$ = located(new ParallelLoop($4, $6, $8, $11, *$10), @$); delete $10; }
      ;
 
+match : MATCH BOX_BRACKET_L expression BOX_BRACKET_R CURLY_BRACKET_L match_cases CURLY_BRACKET_R { $$ = located(new Match($3, *$6), @$); delete $6; }
+      ;
+
+match_cases : match_case             { $$ = new MatchCaseList(); $$->push_back($1); }
+            | match_cases match_case { $1->push_back($2); }
+            ;
+
+match_case : case_patterns METHOD_RETURN_ARROW block { $$ = located(new MatchCase(*$1, $3), @$); delete $1; }
+           ;
+
+case_patterns : case_pattern                            { $$ = new CaseRangeList(); $$->push_back($1); }
+              | case_patterns VERTICAL_BAR case_pattern { $1->push_back($3); }
+              ;
+
+case_pattern : numbers               { $$ = new CaseRange($1, $1); }
+             | numbers RANGE numbers { $$ = new CaseRange($1, $3); }
+             | identifier            { $$ = new CaseRange($1, $1); }
+             ;
+
+region : REGION block { $$ = located(new Region($2), @$); }
+       ;
+
+reductions :                                                { $$ = new ReductionList(); }
+           | REDUCE BOX_BRACKET_L reduction_list BOX_BRACKET_R { $$ = $3; }
+           ;
+
+reduction_list : reduction                      { $$ = new ReductionList(); $$->push_back($1); }
+               | reduction_list COMMA reduction { $1->push_back($3); }
+               ;
+
+reduction : identifier TYPE_ASSIGN PLUS_OP    { $$ = new Reduction(*$1, "+"); }
+          | identifier TYPE_ASSIGN MUL_OP     { $$ = new Reduction(*$1, "*"); }
+          | identifier TYPE_ASSIGN identifier { $$ = new Reduction(*$1, $3->name); delete $3; }
+          ;
+
 comparison : LT 
            | GT 
            | LTE 
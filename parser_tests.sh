@@ -12,6 +12,12 @@ VALID_CODE_SEGMENTS=(
     "if [10 > 20] {} elsif [1 > 2] {} else {}" 
     "loop [i : int = 0; i < 100; i++] {}"
     "loop until [a > b] {}"
+    "parallel loop [i : int = 0; i < 100; i = i + 1] reduce [sum : +] {}"
+    "function numbers(n : int) -> int { yield n }"
+    "loop [x in numbers(10)] {}"
+    "region { buffer : int[] = alloc(10) }"
+    "buffer[1] = buffer[0]"
+    "match [a] { 1 | 2 -> {} 3..9 -> {} _ -> {} }"
     "sum = 10 + 20 + 40"
     "difference = 100 - 52"
     "product = 12 * 22"
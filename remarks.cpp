@@ -0,0 +1,120 @@
+#include "remarks.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+bool RemarkCollector::handleDiagnostics(const llvm::DiagnosticInfo &info)
+{
+    const llvm::DiagnosticInfoOptimizationBase *optimization = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&info);
+
+    if (optimization == nullptr)
+        return false;
+
+    Remark remark;
+    remark.kind = optimization->isPassed() ? "Passed" : optimization->isMissed() ? "Missed" : "Analysis";
+    remark.pass = optimization->getPassName().str();
+    remark.name = optimization->getRemarkName().str();
+    remark.function = optimization->getFunction().getName().str();
+    remark.message = optimization->getMsg();
+
+    if (optimization->isLocationAvailable())
+    {
+        remark.line = optimization->getLocation().getLine();
+        remark.column = optimization->getLocation().getColumn();
+    }
+
+    remarks.push_back(remark);
+    return true;
+}
+
+// Lines of source file, empty when it cannot be read
+static std::vector<std::string> readLines(const std::string &fileName)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(fileName);
+    std::string line;
+
+    while (std::getline(file, line))
+        lines.push_back(line);
+
+    return lines;
+}
+
+void printRemarks(std::vector<Remark> remarks, const std::string &sourceFile)
+{
+    std::vector<std::string> lines = readLines(sourceFile);
+
+    // Remarks without location go last
+    std::stable_sort(remarks.begin(), remarks.end(), [](const Remark &a, const Remark &b) {
+        unsigned aLine = a.line == 0 ? UINT32_MAX : a.line;
+        unsigned bLine = b.line == 0 ? UINT32_MAX : b.line;
+        return aLine != bLine ? aLine < bLine : a.column < b.column;
+    });
+
+    for (const Remark &remark : remarks)
+    {
+        std::string kind = remark.kind;
+        std::transform(kind.begin(), kind.end(), kind.begin(), ::tolower);
+
+        if (remark.line == 0)
+        {
+            std::cout << sourceFile << ": " << kind << ": " << remark.message << " [" << remark.pass << ", " << remark.function << "]" << std::endl;
+            continue;
+        }
+
+        std::cout << sourceFile << ":" << remark.line << ":" << remark.column << ": " << kind << ": " << remark.message << " [" << remark.pass << ", " << remark.function << "]" << std::endl;
+
+        if (remark.line <= lines.size())
+        {
+            std::cout << lines[remark.line - 1] << std::endl;
+            std::cout << std::string(remark.column > 0 ? remark.column - 1 : 0, ' ') << "^" << std::endl;
+        }
+    }
+}
+
+// Single quoted YAML scalar
+static std::string quoted(const std::string &text)
+{
+    std::string result = "'";
+
+    for (char character : text)
+    {
+        if (character == '\'')
+            result += "''";
+        else if (character == '\n')
+            result += ' ';
+        else
+            result += character;
+    }
+
+    return result + "'";
+}
+
+bool writeRemarks(const std::vector<Remark> &remarks, const std::string &sourceFile, const std::string &fileName)
+{
+    std::ofstream file(fileName);
+
+    if (!file)
+    {
+        std::cerr << "Cannot write remarks to " << fileName << "." << std::endl;
+        return false;
+    }
+
+    for (const Remark &remark : remarks)
+    {
+        file << "--- !" << remark.kind << std::endl;
+        file << "Pass:            " << quoted(remark.pass) << std::endl;
+        file << "Name:            " << quoted(remark.name) << std::endl;
+
+        if (remark.line != 0)
+            file << "DebugLoc:        { File: " << quoted(sourceFile) << ", Line: " << remark.line << ", Column: " << remark.column << " }" << std::endl;
+
+        file << "Function:        " << quoted(remark.function) << std::endl;
+        file << "Args:" << std::endl;
+        file << "  - String:          " << quoted(remark.message) << std::endl;
+        file << "..." << std::endl;
+    }
+
+    return true;
+}
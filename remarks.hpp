@@ -0,0 +1,44 @@
+#include <string>
+#include <vector>
+#include <llvm-7/llvm/IR/DiagnosticHandler.h>
+#include <llvm-7/llvm/IR/DiagnosticInfo.h>
+#include <llvm-7/llvm/IR/Function.h>
+
+/**
+ * Optimization remark reported by LLVM pass, located by
+ * debug location of instruction it refers to.
+ */
+class Remark
+{
+public:
+    // Passed, Missed or Analysis
+    std::string kind;
+    std::string pass;
+    std::string name;
+    std::string function;
+    std::string message;
+    unsigned line = 0;
+    unsigned column = 0;
+};
+
+/**
+ * Diagnostic handler collecting every optimization remark,
+ * other diagnostics are left to default handler.
+ */
+class RemarkCollector : public llvm::DiagnosticHandler
+{
+public:
+    std::vector<Remark> remarks;
+
+    bool handleDiagnostics(const llvm::DiagnosticInfo &info) override;
+    bool isAnalysisRemarkEnabled(llvm::StringRef passName) const override { return true; }
+    bool isMissedOptRemarkEnabled(llvm::StringRef passName) const override { return true; }
+    bool isPassedOptRemarkEnabled(llvm::StringRef passName) const override { return true; }
+    bool isAnyRemarkEnabled() const override { return true; }
+};
+
+// Print remarks ordered by line, each followed by its source line
+void printRemarks(std::vector<Remark> remarks, const std::string &sourceFile);
+
+// Write remarks in LLVM optimization record format, readable by opt-viewer
+bool writeRemarks(const std::vector<Remark> &remarks, const std::string &sourceFile, const std::string &fileName);
@@ -0,0 +1,589 @@
+#include "runtime.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    Work-stealing thread pool behind `parallel loop`.
+    Iteration space is split into chunks, each worker gets a contiguous
+    run of chunks in its own deque. Owners pop from the front, idle
+    workers steal from the back of other deques.
+*/
+
+namespace
+{
+// Half-open range of iteration indices
+struct Chunk
+{
+    int64_t begin;
+    int64_t end;
+};
+
+class WorkerQueue
+{
+    std::mutex mutex;
+    std::deque<Chunk> chunks;
+
+public:
+    void push(Chunk chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks.push_back(chunk);
+    }
+
+    bool pop(Chunk &chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty())
+            return false;
+        chunk = chunks.front();
+        chunks.pop_front();
+        return true;
+    }
+
+    bool steal(Chunk &chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty())
+            return false;
+        chunk = chunks.back();
+        chunks.pop_back();
+        return true;
+    }
+};
+
+struct ParallelJob
+{
+    int64_t begin;
+    int64_t step;
+    ParallelBody body;
+    void *environment;
+    std::atomic<int64_t> remaining;
+};
+
+// Set on pool threads so nested parallel loops run serially instead of deadlocking
+thread_local bool insideWorker = false;
+
+// Iterations allocate outside of regions the loop itself runs in, defined with region arena below
+size_t hideRegions();
+void restoreRegions(size_t hidden);
+
+class ThreadPool
+{
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    ParallelJob *job = nullptr;
+    uint64_t generation = 0;
+    int busyWorkers = 0;
+    bool stopping = false;
+
+    void execute(ParallelJob &current, size_t index)
+    {
+        Chunk chunk;
+
+        for (;;)
+        {
+            bool found = queues[index]->pop(chunk);
+
+            for (size_t i = 1; !found && i < queues.size(); i++)
+                found = queues[(index + i) % queues.size()]->steal(chunk);
+
+            if (!found)
+                return;
+
+            current.body(current.begin + chunk.begin * current.step, current.begin + chunk.end * current.step, current.step, current.environment);
+
+            if (current.remaining.fetch_sub(chunk.end - chunk.begin) == chunk.end - chunk.begin)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(size_t index)
+    {
+        uint64_t seenGeneration = 0;
+        insideWorker = true;
+
+        for (;;)
+        {
+            ParallelJob *current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+                if (stopping)
+                    return;
+
+                seenGeneration = generation;
+                current = job;
+
+                // Job was already completed by the other workers
+                if (current == nullptr)
+                    continue;
+
+                busyWorkers++;
+            }
+
+            execute(*current, index);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+            finished.notify_all();
+        }
+    }
+
+public:
+    const size_t workerCount;
+
+    ThreadPool(size_t workerCount) : workerCount(workerCount)
+    {
+        for (size_t i = 0; i < workerCount; i++)
+            queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+
+        // Calling thread acts as worker 0
+        for (size_t i = 1; i < workerCount; i++)
+            threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    void run(int64_t begin, int64_t iterations, int64_t step, ParallelBody body, void *environment)
+    {
+        ParallelJob current;
+        current.begin = begin;
+        current.step = step;
+        current.body = body;
+        current.environment = environment;
+        current.remaining = iterations;
+
+        // Several chunks per worker leave room for stealing when iterations are uneven
+        int64_t chunkCount = std::min<int64_t>(iterations, workerCount * 8);
+        int64_t chunkSize = (iterations + chunkCount - 1) / chunkCount;
+        int64_t chunksPerWorker = (chunkCount + workerCount - 1) / workerCount;
+
+        for (int64_t i = 0; i < chunkCount; i++)
+        {
+            Chunk chunk = {i * chunkSize, std::min(iterations, (i + 1) * chunkSize)};
+            if (chunk.begin < chunk.end)
+                queues[i / chunksPerWorker]->push(chunk);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &current;
+            generation++;
+        }
+
+        wake.notify_all();
+
+        insideWorker = true;
+        execute(current, 0);
+        insideWorker = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return current.remaining == 0 && busyWorkers == 0; });
+        job = nullptr;
+    }
+};
+
+std::mutex poolMutex;
+std::mutex reductionMutex;
+std::unique_ptr<ThreadPool> pool;
+size_t requestedWorkers = 0;
+
+size_t defaultWorkerCount()
+{
+    const char *environmentValue = std::getenv("IRIDIUM_WORKERS");
+
+    if (environmentValue != nullptr && std::atoi(environmentValue) > 0)
+        return std::atoi(environmentValue);
+
+    size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+} // namespace
+
+void iridium_parallel_set_workers(int64_t count)
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    requestedWorkers = count > 0 ? count : 0;
+    pool.reset();
+}
+
+void iridium_parallel_for(int64_t begin, int64_t end, int64_t step, ParallelBody body, void *environment)
+{
+    if (end <= begin)
+        return;
+
+    int64_t iterations = (end - begin + step - 1) / step;
+    size_t hidden = hideRegions();
+
+    if (insideWorker)
+        body(begin, begin + iterations * step, step, environment);
+    else
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+
+        if (pool == nullptr)
+            pool.reset(new ThreadPool(requestedWorkers > 0 ? requestedWorkers : defaultWorkerCount()));
+
+        if (pool->workerCount > 1 && iterations > 1)
+            pool->run(begin, iterations, step, body, environment);
+        else
+        {
+            // Serial loop acts like the only worker, parallel loops nested in it run serially without taking the lock again
+            lock.unlock();
+            insideWorker = true;
+            body(begin, begin + iterations * step, step, environment);
+            insideWorker = false;
+        }
+    }
+
+    restoreRegions(hidden);
+}
+
+void iridium_reduce_lock()
+{
+    reductionMutex.lock();
+}
+
+void iridium_reduce_unlock()
+{
+    reductionMutex.unlock();
+}
+
+int64_t iridium_cpu_level()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // Called from ifunc resolvers, which may run before constructors
+    __builtin_cpu_init();
+
+    if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt"))
+        return 0;
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("bmi2") || !__builtin_cpu_supports("fma"))
+        return 1;
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") || !__builtin_cpu_supports("avx512vl"))
+        return 2;
+    return 3;
+#else
+    return 0;
+#endif
+}
+
+/*
+    Memory behind `alloc`, `free` and `region`.
+    Every block starts with a header naming where it came from. Outside
+    regions blocks come from per-thread free lists of power of two size
+    classes, carved out of slabs that are never returned to the system.
+    Inside a region blocks are bumped out of the thread's arena and all of
+    them are released at once when the region is left, `free` ignores them.
+*/
+
+namespace
+{
+struct BlockHeader
+{
+    uint32_t sizeClass;
+    uint32_t reserved;
+    uint64_t padding;
+};
+
+// Header keeps blocks 16 byte aligned, like malloc does
+static_assert(sizeof(BlockHeader) == 16, "block header must preserve alignment");
+
+const uint32_t arenaClass = 0xfffffffe;
+const uint32_t largeClass = 0xffffffff;
+const size_t smallestClass = 16;
+const size_t classCount = 12;
+const size_t slabSize = 64 * 1024;
+const size_t arenaChunkSize = 64 * 1024;
+
+// Freed block of a size class, link is stored in the block itself
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+class SizeClassPool
+{
+    FreeBlock *freeLists[classCount] = {};
+
+    // Carve new slab into blocks of the class, largest class still fits slab twice
+    void refill(size_t sizeClass)
+    {
+        size_t blockSize = smallestClass << sizeClass;
+        char *slab = static_cast<char *>(std::malloc(slabSize));
+
+        if (slab == nullptr)
+            return;
+
+        for (size_t offset = 0; offset + blockSize <= slabSize; offset += blockSize)
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + offset);
+            block->next = freeLists[sizeClass];
+            freeLists[sizeClass] = block;
+        }
+    }
+
+public:
+    // Size class of block holding size bytes including header, classCount when it is too large
+    static size_t classOf(size_t size)
+    {
+        size_t sizeClass = 0;
+
+        while (sizeClass < classCount && (smallestClass << sizeClass) < size)
+            sizeClass++;
+
+        return sizeClass;
+    }
+
+    void *allocate(size_t sizeClass)
+    {
+        if (freeLists[sizeClass] == nullptr)
+            refill(sizeClass);
+
+        FreeBlock *block = freeLists[sizeClass];
+
+        if (block != nullptr)
+            freeLists[sizeClass] = block->next;
+
+        return block;
+    }
+
+    void release(void *memory, size_t sizeClass)
+    {
+        FreeBlock *block = static_cast<FreeBlock *>(memory);
+        block->next = freeLists[sizeClass];
+        freeLists[sizeClass] = block;
+    }
+};
+
+struct ArenaChunk
+{
+    ArenaChunk *previous;
+    size_t size;
+};
+
+// Position arena is rolled back to when region is left
+struct ArenaMark
+{
+    ArenaChunk *chunk;
+    char *top;
+};
+
+/*
+    Chunks of current regions are linked newest first. Chunks released by
+    leaving a region are kept as spares, so regions entered in a loop
+    settle on their peak usage without calling malloc again.
+*/
+class Arena
+{
+    ArenaChunk *chunk = nullptr;
+    ArenaChunk *spares = nullptr;
+    char *top = nullptr;
+    char *limit = nullptr;
+    std::vector<ArenaMark> marks;
+    // Regions below are hidden while thread runs iterations of a parallel loop
+    size_t hiddenMarks = 0;
+
+    void grow(size_t size)
+    {
+        size_t wanted = sizeof(ArenaChunk) + size;
+        ArenaChunk **spare = &spares;
+
+        while (*spare != nullptr && (*spare)->size < wanted)
+            spare = &(*spare)->previous;
+
+        ArenaChunk *next = *spare;
+
+        if (next != nullptr)
+            *spare = next->previous;
+        else
+        {
+            size_t chunkSize = std::max(arenaChunkSize, wanted);
+            next = static_cast<ArenaChunk *>(std::malloc(chunkSize));
+
+            if (next == nullptr)
+                return;
+
+            next->size = chunkSize;
+        }
+
+        next->previous = chunk;
+        chunk = next;
+        top = reinterpret_cast<char *>(next + 1);
+        limit = reinterpret_cast<char *>(next) + next->size;
+    }
+
+public:
+    bool active() const
+    {
+        return marks.size() > hiddenMarks;
+    }
+
+    // Hide regions entered so far until restored, returns previously hidden count
+    size_t hide()
+    {
+        size_t previous = hiddenMarks;
+        hiddenMarks = marks.size();
+        return previous;
+    }
+
+    void restore(size_t previous)
+    {
+        hiddenMarks = previous;
+    }
+
+    int64_t enter()
+    {
+        marks.push_back(ArenaMark{chunk, top});
+        return marks.size() - 1;
+    }
+
+    // Leaving outer region also leaves regions nested in it
+    void leave(int64_t depth)
+    {
+        if (depth < 0 || (size_t)depth >= marks.size())
+            return;
+
+        ArenaMark mark = marks[depth];
+        marks.resize(depth);
+
+        while (chunk != mark.chunk)
+        {
+            ArenaChunk *released = chunk;
+            chunk = released->previous;
+            released->previous = spares;
+            spares = released;
+        }
+
+        top = mark.top;
+        limit = chunk != nullptr ? reinterpret_cast<char *>(chunk) + chunk->size : nullptr;
+    }
+
+    // Size is a multiple of 16, chunk data starts 16 byte aligned
+    void *allocate(size_t size)
+    {
+        if (top == nullptr || (size_t)(limit - top) < size)
+            grow(size);
+
+        if (top == nullptr || (size_t)(limit - top) < size)
+            return nullptr;
+
+        void *memory = top;
+        top += size;
+        return memory;
+    }
+};
+
+static_assert(sizeof(ArenaChunk) == 16, "arena chunk header must preserve alignment");
+
+thread_local SizeClassPool memoryPool;
+thread_local Arena regionArena;
+
+size_t hideRegions()
+{
+    return regionArena.hide();
+}
+
+void restoreRegions(size_t hidden)
+{
+    regionArena.restore(hidden);
+}
+} // namespace
+
+void *iridium_alloc(int64_t size)
+{
+    if (size < 0)
+    {
+        std::fprintf(stderr, "alloc: element count is negative or too large\n");
+        std::abort();
+    }
+
+    size_t blockSize = ((size > 0 ? size : 1) + sizeof(BlockHeader) + 15) & ~(size_t)15;
+    BlockHeader *header;
+
+    if (regionArena.active())
+    {
+        header = static_cast<BlockHeader *>(regionArena.allocate(blockSize));
+        if (header != nullptr)
+            header->sizeClass = arenaClass;
+    }
+    else if (SizeClassPool::classOf(blockSize) < classCount)
+    {
+        size_t sizeClass = SizeClassPool::classOf(blockSize);
+        header = static_cast<BlockHeader *>(memoryPool.allocate(sizeClass));
+        if (header != nullptr)
+            header->sizeClass = sizeClass;
+    }
+    else
+    {
+        header = static_cast<BlockHeader *>(std::malloc(blockSize));
+        if (header != nullptr)
+            header->sizeClass = largeClass;
+    }
+
+    if (header == nullptr)
+    {
+        std::fprintf(stderr, "alloc: out of memory\n");
+        std::abort();
+    }
+
+    return header + 1;
+}
+
+void iridium_free(void *memory)
+{
+    if (memory == nullptr)
+        return;
+
+    BlockHeader *header = static_cast<BlockHeader *>(memory) - 1;
+
+    if (header->sizeClass == largeClass)
+        std::free(header);
+    else if (header->sizeClass != arenaClass)
+        memoryPool.release(header, header->sizeClass);
+}
+
+int64_t iridium_region_enter()
+{
+    return regionArena.enter();
+}
+
+void iridium_region_leave(int64_t depth)
+{
+    regionArena.leave(depth);
+}
+
+void *iridium_frame_alloc(int64_t size)
+{
+    return std::malloc(size);
+}
+
+void iridium_frame_free(void *frame)
+{
+    std::free(frame);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Runtime support library linked into compiled Iridium programs.
+ * Generated code calls these functions directly, so they use C linkage.
+ */
+extern "C"
+{
+    // Outlined parallel loop body, runs iterations first, first + step, ... below last
+    typedef void (*ParallelBody)(int64_t first, int64_t last, int64_t step, void *environment);
+
+    void iridium_parallel_for(int64_t begin, int64_t end, int64_t step, ParallelBody body, void *environment);
+    void iridium_parallel_set_workers(int64_t count);
+    void iridium_reduce_lock();
+    void iridium_reduce_unlock();
+
+    // x86-64 feature level of running CPU: 0 baseline, 1 v2 (SSE4.2), 2 v3 (AVX2), 3 v4 (AVX-512)
+    int64_t iridium_cpu_level();
+
+    // Block of at least size bytes, 16 byte aligned, from current region or from size class pool.
+    // Aborts on negative size or when memory runs out.
+    void *iridium_alloc(int64_t size);
+    // Return block to its pool, blocks of regions are released by leaving the region
+    void iridium_free(void *memory);
+
+    // Start region on calling thread, returns its depth to be passed to iridium_region_leave
+    int64_t iridium_region_enter();
+    // Release everything allocated since region of given depth and regions nested in it were entered
+    void iridium_region_leave(int64_t depth);
+
+    // Frame of generator whose allocation optimizer could not elide, independent of regions
+    void *iridium_frame_alloc(int64_t size);
+    void iridium_frame_free(void *frame);
+}
@@ -0,0 +1,197 @@
+#include "target.hpp"
+#include <iostream>
+#include <llvm-7/llvm/ADT/StringMap.h>
+#include <llvm-7/llvm/ADT/Triple.h>
+#include <llvm-7/llvm/Analysis/CFG.h>
+#include <llvm-7/llvm/IR/GlobalIFunc.h>
+#include <llvm-7/llvm/IR/IRBuilder.h>
+#include <llvm-7/llvm/MC/MCSubtargetInfo.h>
+#include <llvm-7/llvm/Support/Host.h>
+#include <llvm-7/llvm/Support/TargetRegistry.h>
+#include <llvm-7/llvm/Support/TargetSelect.h>
+#include <llvm-7/llvm/Target/TargetMachine.h>
+#include <llvm-7/llvm/Transforms/Utils/Cloning.h>
+
+/**
+ * x86-64 feature level a function clone is compiled for. Resolver picks
+ * the highest level reported by iridium_cpu_level in the runtime.
+ */
+struct FeatureLevel
+{
+    int level;
+    const char *suffix;
+    const char *features;
+};
+
+// Every x86-64 CPU runs this, whatever --cpu the rest of the module is compiled for
+static const char *baselineCPU = "x86-64";
+static const char *baselineFeatures = "+cx8,+fxsr,+mmx,+sse,+sse2";
+
+static const FeatureLevel featureLevels[] = {
+    {1, "x86_64_v2", "+cx16,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3"},
+    {2, "x86_64_v3", "+cx16,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3,+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe"},
+    {3, "x86_64_v4", "+cx16,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3,+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+avx512f,+avx512bw,+avx512cd,+avx512dq,+avx512vl"},
+};
+
+std::string hostCPUName()
+{
+    return llvm::sys::getHostCPUName().str();
+}
+
+std::vector<std::string> hostCPUFeatures()
+{
+    llvm::StringMap<bool> features;
+    std::vector<std::string> attributes;
+
+    if (llvm::sys::getHostCPUFeatures(features))
+        for (auto &feature : features)
+            attributes.push_back((feature.second ? "+" : "-") + feature.first().str());
+
+    return attributes;
+}
+
+llvm::TargetMachine *configureTarget(llvm::Module &module, const std::string &cpu)
+{
+    llvm::InitializeNativeTarget();
+
+    std::string error;
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+
+    if (target == nullptr)
+    {
+        std::cerr << "Target " << triple << " is unavailable: " << error << std::endl;
+        return nullptr;
+    }
+
+    std::string cpuName = cpu == "native" ? hostCPUName() : cpu;
+    std::string features;
+
+    if (cpu == "native")
+        for (const std::string &attribute : hostCPUFeatures())
+            features += (features.empty() ? "" : ",") + attribute;
+
+    llvm::TargetMachine *targetMachine = target->createTargetMachine(triple, cpuName.empty() ? "generic" : cpuName, features, llvm::TargetOptions(), llvm::None);
+
+    if (!cpuName.empty() && !targetMachine->getMCSubtargetInfo()->isCPUStringValid(cpuName))
+    {
+        std::cerr << "CPU " << cpuName << " is unknown for target " << triple << "." << std::endl;
+        delete targetMachine;
+        return nullptr;
+    }
+
+    module.setTargetTriple(triple);
+    module.setDataLayout(targetMachine->createDataLayout());
+
+    if (cpuName.empty())
+        return targetMachine;
+
+    for (llvm::Function &function : module)
+    {
+        if (function.isDeclaration())
+            continue;
+
+        function.addFnAttr("target-cpu", cpuName);
+        if (!features.empty())
+            function.addFnAttr("target-features", features);
+    }
+
+    return targetMachine;
+}
+
+// Functions with back edges are where wider vectors pay off
+static bool containsLoop(const llvm::Function &function)
+{
+    llvm::SmallVector<std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>, 8> backEdges;
+    llvm::FindFunctionBackedges(function, backEdges);
+    return !backEdges.empty();
+}
+
+/*
+    Calls through ifunc are never inlined, so only functions that stay out
+    of line anyway are versioned: parallel loop bodies handed to the runtime
+    and functions called from main only. Generators have to be inlined into
+    their consumer for their frame to be elided.
+*/
+static bool staysOutOfLine(llvm::Function &function)
+{
+    if (function.hasFnAttribute("coroutine.presplit"))
+        return false;
+
+    for (llvm::User *user : function.users())
+    {
+        llvm::CallInst *call = llvm::dyn_cast<llvm::CallInst>(user);
+        if (call != nullptr && call->getCalledFunction() == &function && call->getFunction()->getName() != "main")
+            return false;
+    }
+
+    return true;
+}
+
+void multiversionFunctions(llvm::Module &module)
+{
+    if (llvm::Triple(module.getTargetTriple()).getArch() != llvm::Triple::x86_64)
+    {
+        std::cerr << "Multiversioning is only supported on x86-64, ignored." << std::endl;
+        return;
+    }
+
+    llvm::LLVMContext &context = module.getContext();
+    llvm::FunctionType *levelType = llvm::FunctionType::get(llvm::Type::getInt64Ty(context), false);
+    llvm::Function *cpuLevel = module.getFunction("iridium_cpu_level");
+
+    if (cpuLevel == nullptr)
+        cpuLevel = llvm::Function::Create(levelType, llvm::GlobalValue::ExternalLinkage, "iridium_cpu_level", &module);
+
+    std::vector<llvm::Function *> candidates;
+    for (llvm::Function &function : module)
+        if (!function.isDeclaration() && function.getName() != "main" && containsLoop(function) && staysOutOfLine(function))
+            candidates.push_back(&function);
+
+    for (llvm::Function *function : candidates)
+    {
+        std::string name = function->getName().str();
+        std::vector<llvm::Function *> clones;
+
+        // Clones use the baseline target-cpu and add the features of their level,
+        // CPU given with --cpu must not leak instructions into lower levels
+        for (const FeatureLevel &featureLevel : featureLevels)
+        {
+            llvm::ValueToValueMapTy valueMap;
+            llvm::Function *clone = llvm::CloneFunction(function, valueMap);
+            clone->setName(name + "." + featureLevel.suffix);
+            clone->addFnAttr("target-cpu", baselineCPU);
+            clone->addFnAttr("target-features", featureLevel.features);
+            clones.push_back(clone);
+        }
+
+        function->setName(name + ".default");
+        function->addFnAttr("target-cpu", baselineCPU);
+        function->addFnAttr("target-features", baselineFeatures);
+
+        llvm::GlobalIFunc *dispatch = llvm::GlobalIFunc::create(function->getFunctionType(), 0, function->getLinkage(), name, llvm::UndefValue::get(function->getType()), &module);
+        function->replaceAllUsesWith(dispatch);
+        function->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+        for (llvm::Function *clone : clones)
+            clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+        // Resolver runs once at load time, before any call goes through the ifunc
+        llvm::FunctionType *resolverType = llvm::FunctionType::get(function->getType(), false);
+        llvm::Function *resolver = llvm::Function::Create(resolverType, llvm::GlobalValue::InternalLinkage, name + ".resolver", &module);
+        resolver->addFnAttr("target-cpu", baselineCPU);
+        resolver->addFnAttr("target-features", baselineFeatures);
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", resolver));
+        llvm::Value *level = builder.CreateCall(cpuLevel);
+        llvm::Value *selected = function;
+
+        for (size_t i = 0; i < clones.size(); i++)
+        {
+            llvm::Value *supported = builder.CreateICmpSGE(level, llvm::ConstantInt::get(levelType->getReturnType(), featureLevels[i].level));
+            selected = builder.CreateSelect(supported, clones[i], selected);
+        }
+
+        builder.CreateRet(selected);
+        dispatch->setResolver(resolver);
+    }
+}
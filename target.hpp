@@ -0,0 +1,21 @@
+#include <string>
+#include <vector>
+#include <llvm-7/llvm/IR/Module.h>
+#include <llvm-7/llvm/Target/TargetMachine.h>
+
+/*
+    Target machine selection for generated code.
+    JIT always compiles for the host CPU, ahead of time builds pick CPU with
+    --cpu and can multiversion hot functions for several x86-64 feature levels.
+*/
+
+// Name and features ("+avx2", "-avx512f", ...) of the CPU compiler runs on
+std::string hostCPUName();
+std::vector<std::string> hostCPUFeatures();
+
+// Set triple, data layout and target-cpu/target-features of every function, cpu can be "native".
+// Returns machine module is compiled for, owned by caller, or nullptr when cpu is unknown.
+llvm::TargetMachine *configureTarget(llvm::Module &module, const std::string &cpu);
+
+// Clone out of line functions containing loops per feature level and dispatch to them through ifunc resolver
+void multiversionFunctions(llvm::Module &module);
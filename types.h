@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+
+/**
+ * Source level type of a value. LLVM integer types carry no sign,
+ * so signedness is kept here to pick extensions, divisions and compares.
+ */
+class ValueType
+{
+public:
+    enum Kind
+    {
+        Void,
+        Bool,
+        Integer,
+        Float,
+        String,
+        Pointer
+    };
+
+    Kind kind;
+    unsigned bits;
+    bool isSigned;
+    // Kind of values pointer points to, their width and sign are kept in bits and isSigned
+    Kind elementKind = Void;
+
+    ValueType(Kind kind = Void, unsigned bits = 0, bool isSigned = false) : kind(kind), bits(bits), isSigned(isSigned) {}
+
+    bool isInteger() const { return kind == Integer; }
+    bool isFloat() const { return kind == Float; }
+    bool isNumeric() const { return kind == Integer || kind == Float; }
+    bool isPointer() const { return kind == Pointer; }
+
+    // Pointer to memory holding values of given type, void element is untyped memory
+    static ValueType pointerTo(const ValueType &element)
+    {
+        ValueType type(Pointer, element.bits, element.isSigned);
+        type.elementKind = element.kind;
+        return type;
+    }
+
+    ValueType element() const
+    {
+        return ValueType(elementKind, bits, isSigned);
+    }
+
+    bool operator==(const ValueType &other) const
+    {
+        return kind == other.kind && bits == other.bits && isSigned == other.isSigned && elementKind == other.elementKind;
+    }
+
+    bool operator!=(const ValueType &other) const
+    {
+        return !(*this == other);
+    }
+
+    // Resolve type name used in declarations, unknown names give Void with valid set to false
+    static ValueType fromName(const std::string &name, bool *valid = nullptr)
+    {
+        // Buffer of values, "Int[]" points to Ints
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, "[]") == 0)
+        {
+            ValueType element = fromName(name.substr(0, name.size() - 2), valid);
+
+            if (element.kind != Void && element.kind != Pointer)
+                return pointerTo(element);
+
+            if (valid != nullptr)
+                *valid = false;
+
+            return ValueType(Void);
+        }
+
+        static const struct
+        {
+            const char *name;
+            ValueType type;
+        } names[] = {
+            {"Int", ValueType(Integer, 64, true)},
+            {"Int8", ValueType(Integer, 8, true)},
+            {"Int16", ValueType(Integer, 16, true)},
+            {"Int32", ValueType(Integer, 32, true)},
+            {"Int64", ValueType(Integer, 64, true)},
+            {"UInt", ValueType(Integer, 64, false)},
+            {"UInt8", ValueType(Integer, 8, false)},
+            {"UInt16", ValueType(Integer, 16, false)},
+            {"UInt32", ValueType(Integer, 32, false)},
+            {"UInt64", ValueType(Integer, 64, false)},
+            {"Bool", ValueType(Bool, 1)},
+            {"Float", ValueType(Float, 32, true)},
+            {"Double", ValueType(Float, 64, true)},
+            {"String", ValueType(String, 64)},
+            {"void", ValueType(Void)},
+        };
+
+        if (valid != nullptr)
+            *valid = true;
+
+        for (auto &entry : names)
+            if (name == entry.name)
+                return entry.type;
+
+        if (valid != nullptr)
+            *valid = false;
+
+        return ValueType(Void);
+    }
+
+    std::string name() const
+    {
+        switch (kind)
+        {
+        case Bool:
+            return "Bool";
+        case Integer:
+            return (isSigned ? "Int" : "UInt") + std::to_string(bits);
+        case Float:
+            return bits == 32 ? "Float" : "Double";
+        case String:
+            return "String";
+        case Pointer:
+            return element().name() + "[]";
+        default:
+            return "void";
+        }
+    }
+};